@@ -0,0 +1,117 @@
+#ifndef SROTHMAN_MATCHING_V2_BOUNDEDQUEUE_H
+#define SROTHMAN_MATCHING_V2_BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace matching {
+    /*
+     * Bounded lock-free multi-producer multi-consumer queue
+     * (Vyukov's array-based algorithm)
+     *
+     * Each cell carries a sequence number which tells producers
+     * and consumers whether the cell is free to write or ready to read.
+     * try_push() fails when the queue is full, try_pop() fails
+     * when it is empty; it is up to the caller to decide how to wait.
+     *
+     * capacity is rounded up to the next power of two (at least 2)
+     */
+    template <typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(const size_t capacity) :
+            buffer(nullptr),
+            mask(0),
+            enqueue_pos(0),
+            dequeue_pos(0) {
+
+            if(capacity == 0){
+                throw std::invalid_argument("BoundedQueue capacity must be > 0");
+            }
+
+            //with a single cell a full queue would look empty to
+            //producers (the sequence numbers of "written" and "free"
+            //coincide), so the smallest size is 2
+            size_t size = 2;
+            while(size < capacity){
+                size <<= 1;
+            }
+            mask = size - 1;
+
+            buffer = std::make_unique<cell[]>(size);
+            for(size_t i=0; i<size; ++i){
+                buffer[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool try_push(T&& value){
+            size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+            cell* thecell;
+            while(true){
+                thecell = &buffer[pos & mask];
+                size_t seq = thecell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if(diff == 0){
+                    if(enqueue_pos.compare_exchange_weak(
+                                pos, pos+1, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if(diff < 0){
+                    return false; //full
+                } else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            thecell->data = std::move(value);
+            thecell->sequence.store(pos+1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T& value){
+            size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+            cell* thecell;
+            while(true){
+                thecell = &buffer[pos & mask];
+                size_t seq = thecell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos+1);
+                if(diff == 0){
+                    if(dequeue_pos.compare_exchange_weak(
+                                pos, pos+1, std::memory_order_relaxed)){
+                        break;
+                    }
+                } else if(diff < 0){
+                    return false; //empty
+                } else {
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            value = std::move(thecell->data);
+            thecell->sequence.store(pos+mask+1, std::memory_order_release);
+            return true;
+        }
+
+        size_t capacity() const {
+            return mask+1;
+        }
+
+    private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<cell[]> buffer;
+        size_t mask;
+
+        //keep producers and consumers on separate cache lines
+        alignas(64) std::atomic<size_t> enqueue_pos;
+        alignas(64) std::atomic<size_t> dequeue_pos;
+    };
+};
+
+#endif
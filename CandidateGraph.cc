@@ -0,0 +1,409 @@
+#include "CandidateGraph.h"
+#include "GenIndex.h"
+#include "MatchHelpers.h"
+#include "EtaPhiGrid.h"
+
+#include <algorithm>
+#include <future>
+
+matching::CandidateGraph::CandidateGraph() :
+    row_start(2, 0),
+    edges(),
+    gen_order(),
+    gen_row(),
+    reco_rank(),
+    reco_dRlim(),
+    reco_pt(),
+    reco_flavor(),
+    gen_pt(),
+    truncation() {}
+
+namespace {
+    struct rowedges {
+        std::vector<matching::CandidateGraph::edge> edges;
+        std::vector<size_t> counts;
+        size_t nGenTruncated = 0;
+        size_t nCandidatesDropped = 0;
+    };
+
+    //lower chisq first, ties to the higher-pT reco particle
+    struct edge_less {
+        const std::vector<size_t>& reco_rank;
+
+        bool operator()(const matching::CandidateGraph::edge& e1,
+                        const matching::CandidateGraph::edge& e2) const {
+            if(e1.chisq != e2.chisq){
+                return e1.chisq < e2.chisq;
+            }
+            return reco_rank[e1.iReco] < reco_rank[e2.iReco];
+        }
+    };
+};
+
+void matching::CandidateGraph::build(
+        const std::vector<simon::particle>& recoparts,
+        const std::vector<simon::particle>& genparts,
+        const PerFlavorMatchParams& params,
+        const double max_chisq,
+        const Strategy strategy,
+        const unsigned nthreads,
+        const size_t max_candidates,
+        const size_t max_pairs,
+        const double reco_jetpt,
+        const double gen_jetpt){
+    build_impl(recoparts, genparts, params, max_chisq,
+               strategy, nthreads, max_candidates, max_pairs,
+               reco_jetpt, gen_jetpt, nullptr);
+}
+
+void matching::CandidateGraph::build(
+        const std::vector<simon::particle>& recoparts,
+        const GenIndex& genindex,
+        const PerFlavorMatchParams& params,
+        const double max_chisq,
+        const size_t max_candidates,
+        const size_t max_pairs){
+    build_impl(recoparts, genindex.event_particles(), params, max_chisq,
+               GRID, 1, max_candidates, max_pairs,
+               0, 0, &genindex);
+}
+
+void matching::CandidateGraph::build_impl(
+        const std::vector<simon::particle>& recoparts,
+        const std::vector<simon::particle>& genparts,
+        const PerFlavorMatchParams& params,
+        const double max_chisq,
+        const Strategy strategy,
+        const unsigned nthreads,
+        const size_t max_candidates,
+        const size_t max_pairs,
+        const double reco_jetpt,
+        const double gen_jetpt,
+        const GenIndex* genindex){
+
+    //the GenIndex pT order already has the acceptance applied
+    if(genindex){
+        gen_order = genindex->event_ptorder();
+    } else {
+        detail::get_ptorder(genparts, gen_order);
+        detail::apply_acceptance(genparts, params, gen_jetpt, gen_order);
+    }
+
+    std::vector<size_t> reco_order;
+    detail::get_ptorder(recoparts, reco_order);
+
+    reco_rank.resize(recoparts.size());
+    for(size_t rank=0; rank<reco_order.size(); ++rank){
+        reco_rank[reco_order[rank]] = rank;
+    }
+
+    detail::reco_index index;
+    detail::build_reco_index(recoparts, params, reco_jetpt, reco_order, index);
+
+    //gen particles outside the acceptance point to the empty last row
+    const size_t nrows = gen_order.size();
+    gen_row.assign(genparts.size(), nrows);
+    gen_pt.resize(genparts.size());
+    for(size_t iGen=0; iGen<genparts.size(); ++iGen){
+        gen_pt[iGen] = genparts[iGen].pt;
+    }
+    for(size_t row=0; row<nrows; ++row){
+        gen_row[gen_order[row]] = row;
+    }
+
+    reco_dRlim = index.dRlim;
+    reco_flavor = index.flavor;
+    reco_pt.resize(recoparts.size());
+    for(size_t iReco=0; iReco<recoparts.size(); ++iReco){
+        reco_pt[iReco] = recoparts[iReco].pt;
+    }
+
+    row_start.assign(nrows+2, 0);
+    edges.clear();
+    truncation = truncationinfo();
+
+    const edge_less less{reco_rank};
+
+    //the pair cap is applied in whole rows, in gen pT order,
+    //counting nReco evaluations per row for every strategy,
+    //so that the graph does not depend on the strategy
+    size_t nevaluated = nrows;
+    if(max_pairs > 0 && !reco_order.empty()){
+        const size_t maxrows = max_pairs / reco_order.size();
+        if(maxrows < nevaluated){
+            nevaluated = maxrows;
+            truncation.pair_cap_hit = true;
+        }
+    }
+
+    if(strategy == GRID){
+        MATCHING_TRACE_SCOPE("candidate evaluation");
+
+        EtaPhiGrid localgrid;
+        const EtaPhiGrid* grid = &localgrid;
+        const uint8_t* classes = nullptr;
+        if(genindex){
+            grid = &genindex->event_grid();
+            classes = genindex->event_flavor_classes();
+        } else {
+            double max_dRlim = 0;
+            for(size_t iReco : reco_order){
+                max_dRlim = std::max(max_dRlim, index.dRlim[iReco]);
+            }
+            localgrid.build(genparts, max_dRlim);
+        }
+
+        //the grid finds the pairs reco-by-reco,
+        //so collect them first and then bucket them by row
+        std::vector<size_t> rows;
+        std::vector<edge> found;
+        size_t npairs = 0;
+        for(size_t iReco : reco_order){
+            const auto& reco = recoparts[iReco];
+
+            const unsigned flavorbit = 1u << index.flavor[iReco];
+
+            grid->for_each_near(reco.eta, reco.phi, index.dRlim[iReco],
+                [&](size_t iGen){
+                    //outside the acceptance, or beyond the pair cap
+                    if(gen_row[iGen] >= nevaluated) return;
+
+                    ++npairs;
+
+                    if(classes && !(classes[iGen] & flavorbit)) return;
+
+                    double dR, chisq;
+                    if(!detail::evaluate_pair(reco, genparts[iGen],
+                                              *index.params[iReco],
+                                              index.dRlim[iReco],
+                                              dR, chisq,
+                                              classes == nullptr)) return;
+
+                    //written this way to also reject NaN
+                    if(!(chisq < max_chisq)) return;
+
+                    rows.push_back(gen_row[iGen]);
+                    found.push_back({iReco, chisq, dR});
+                });
+        }
+        truncation.nPairsEvaluated = npairs;
+
+        for(size_t row : rows){
+            ++row_start[row+1];
+        }
+        for(size_t row=1; row<row_start.size(); ++row){
+            row_start[row] += row_start[row-1];
+        }
+        edges.resize(found.size());
+        std::vector<size_t> fill(row_start.begin(), row_start.end()-1);
+        for(size_t i=0; i<found.size(); ++i){
+            edges[fill[rows[i]]++] = found[i];
+        }
+
+        //sort each row, and compact away the edges
+        //beyond max_candidates if there is a cap
+        size_t kept = 0;
+        for(size_t row=0; row<nrows; ++row){
+            const size_t begin = row_start[row];
+            const size_t end = row_start[row+1];
+            std::sort(edges.begin() + begin, edges.begin() + end, less);
+
+            size_t nkeep = end - begin;
+            if(max_candidates > 0 && nkeep > max_candidates){
+                truncation.nGenTruncated += 1;
+                truncation.nCandidatesDropped += nkeep - max_candidates;
+                nkeep = max_candidates;
+            }
+            std::move(edges.begin() + begin, edges.begin() + begin + nkeep,
+                      edges.begin() + kept);
+            row_start[row] = kept;
+            kept += nkeep;
+        }
+        row_start[nrows] = kept;
+        row_start[nrows+1] = kept;
+        edges.resize(kept);
+        return;
+    }
+
+    //BRUTEFORCE
+    //each slice covers a contiguous range of rows,
+    //so the slices can simply be concatenated afterwards
+    auto evaluate_slice = [&](size_t begin, size_t end, rowedges& out){
+        MATCHING_TRACE_SCOPE("candidate evaluation");
+
+        for(size_t row = begin; row < end; ++row){
+            const auto& gen = genparts[gen_order[row]];
+            const size_t first = out.edges.size();
+            size_t nfound = 0;
+
+            for(size_t iReco : reco_order){
+                double dR, chisq;
+                if(!detail::evaluate_pair(recoparts[iReco], gen,
+                                          *index.params[iReco],
+                                          index.dRlim[iReco],
+                                          dR, chisq)) continue;
+
+                if(!(chisq < max_chisq)) continue;
+
+                ++nfound;
+                const edge theedge{iReco, chisq, dR};
+                if(max_candidates == 0){
+                    out.edges.push_back(theedge);
+                } else if(nfound <= max_candidates){
+                    //max-heap with the worst kept edge on top
+                    out.edges.push_back(theedge);
+                    std::push_heap(out.edges.begin() + first, out.edges.end(), less);
+                } else if(less(theedge, out.edges[first])){
+                    std::pop_heap(out.edges.begin() + first, out.edges.end(), less);
+                    out.edges.back() = theedge;
+                    std::push_heap(out.edges.begin() + first, out.edges.end(), less);
+                }
+            }//end reco loop
+
+            if(max_candidates == 0){
+                std::sort(out.edges.begin() + first, out.edges.end(), less);
+            } else {
+                std::sort_heap(out.edges.begin() + first, out.edges.end(), less);
+                if(nfound > max_candidates){
+                    out.nGenTruncated += 1;
+                    out.nCandidatesDropped += nfound - max_candidates;
+                }
+            }
+            out.counts.push_back(out.edges.size() - first);
+        }//end gen loop
+    };
+
+    truncation.nPairsEvaluated = nevaluated * reco_order.size();
+
+    const size_t nslices = std::max<size_t>(1, std::min<size_t>(nthreads, nevaluated));
+    const size_t slicesize = nevaluated > 0 ? (nevaluated + nslices - 1)/nslices : 0;
+
+    std::vector<rowedges> slices(nslices);
+
+    //the calling thread takes the first slice itself
+    std::vector<std::future<void>> futures;
+    futures.reserve(nslices-1);
+    for(size_t iSlice=1; iSlice<nslices; ++iSlice){
+        const size_t begin = std::min(iSlice*slicesize, nevaluated);
+        const size_t end = std::min(begin+slicesize, nevaluated);
+        futures.push_back(std::async(std::launch::async,
+                                     evaluate_slice, begin, end,
+                                     std::ref(slices[iSlice])));
+    }
+    evaluate_slice(0, std::min(slicesize, nevaluated), slices[0]);
+    for(auto& future : futures){
+        future.get();
+    }
+
+    size_t row = 0;
+    for(const auto& slice : slices){
+        for(size_t count : slice.counts){
+            row_start[row+1] = row_start[row] + count;
+            ++row;
+        }
+        truncation.nGenTruncated += slice.nGenTruncated;
+        truncation.nCandidatesDropped += slice.nCandidatesDropped;
+    }
+    //rows beyond the pair cap are left empty
+    for(; row+1 < row_start.size(); ++row){
+        row_start[row+1] = row_start[row];
+    }
+    if(nslices == 1){
+        edges = std::move(slices[0].edges);
+    } else {
+        edges.reserve(row_start.back());
+        for(const auto& slice : slices){
+            edges.insert(edges.end(), slice.edges.begin(), slice.edges.end());
+        }
+    }
+}
+
+void matching::CandidateGraph::fill_info(
+        const edge& theedge,
+        const size_t iGen,
+        matchinfovec& infos) const {
+    infos.emplace_back(
+            theedge.chisq, theedge.dR,
+            reco_dRlim[theedge.iReco],
+            reco_pt[theedge.iReco] - gen_pt[iGen],
+            reco_flavor[theedge.iReco]);
+}
+
+void matching::assign_greedy(
+        const CandidateGraph& graph,
+        matchvec& matches,
+        matchinfovec* infos){
+    MATCHING_TRACE_SCOPE("assignment");
+
+    matches.clear();
+    if(infos){
+        infos->clear();
+    }
+
+    std::vector<bool> reco_used(graph.nReco(), false);
+    for(size_t iGen : graph.gen_ptorder()){
+        for(const auto* e = graph.begin(iGen); e != graph.end(iGen); ++e){
+            if(reco_used[e->iReco]) continue;
+
+            reco_used[e->iReco] = true;
+            matches.emplace_back(e->iReco, iGen);
+            if(infos){
+                graph.fill_info(*e, iGen, *infos);
+            }
+            break;
+        }
+    }
+}
+
+void matching::assign_global_greedy(
+        const CandidateGraph& graph,
+        matchvec& matches,
+        matchinfovec* infos){
+    MATCHING_TRACE_SCOPE("assignment");
+
+    matches.clear();
+    if(infos){
+        infos->clear();
+    }
+
+    struct globaledge {
+        const CandidateGraph::edge* e;
+        size_t iGen;
+        size_t genrank;
+    };
+
+    std::vector<globaledge> all;
+    all.reserve(graph.nEdges());
+    const auto& gen_ptorder = graph.gen_ptorder();
+    for(size_t genrank=0; genrank<gen_ptorder.size(); ++genrank){
+        const size_t iGen = gen_ptorder[genrank];
+        for(const auto* e = graph.begin(iGen); e != graph.end(iGen); ++e){
+            all.push_back({e, iGen, genrank});
+        }
+    }
+
+    std::sort(all.begin(), all.end(),
+            [&](const globaledge& g1, const globaledge& g2){
+                if(g1.e->chisq != g2.e->chisq){
+                    return g1.e->chisq < g2.e->chisq;
+                }
+                if(g1.genrank != g2.genrank){
+                    return g1.genrank < g2.genrank;
+                }
+                return graph.get_reco_rank(g1.e->iReco)
+                     < graph.get_reco_rank(g2.e->iReco);
+            });
+
+    std::vector<bool> reco_used(graph.nReco(), false);
+    std::vector<bool> gen_used(graph.nGen(), false);
+    for(const auto& g : all){
+        if(reco_used[g.e->iReco] || gen_used[g.iGen]) continue;
+
+        reco_used[g.e->iReco] = true;
+        gen_used[g.iGen] = true;
+        matches.emplace_back(g.e->iReco, g.iGen);
+        if(infos){
+            graph.fill_info(*g.e, g.iGen, *infos);
+        }
+    }
+}
@@ -0,0 +1,187 @@
+#ifndef SROTHMAN_MATCHING_V2_CANDIDATEGRAPH_H
+#define SROTHMAN_MATCHING_V2_CANDIDATEGRAPH_H
+
+#include "SRothman/SimonTools/src/jet.h"
+#include "PerFlavorMatchParams.h"
+#include "MatchTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace matching {
+    class GenIndex;
+
+    /*
+     * Sparse bipartite graph of the admissible (reco, gen) particle pairs
+     *
+     * A pair is admissible if it passes the dR limit and the charge
+     * and flavor filters of the reco particle's flavor, and has
+     * chisq < max_chisq. Building the graph is the expensive part of
+     * the matching (all the geometry and chisq evaluations), so it can
+     * be built once and then inspected, cached, or fed to any number
+     * of assignment routines.
+     *
+     * Stored in CSR form, with one row per gen particle. The edges of
+     * each row are sorted by increasing chisq, with ties broken in favor
+     * of the higher-pT reco particle. The graph keeps the few per-particle
+     * quantities needed to fill matchinfo records, so it does not need
+     * the particle collections once it has been built.
+     */
+    class CandidateGraph {
+    public:
+        struct edge {
+            size_t iReco;
+            double chisq;
+            double dR;
+        };
+
+        enum Strategy {
+            BRUTEFORCE=0, //every reco particle against every gen particle
+            GRID=1        //only pairs found through an (eta, phi) grid
+        };
+
+        CandidateGraph();
+
+        /*
+         * nthreads > 1 splits the BRUTEFORCE pair evaluation
+         * across threads; it is ignored for GRID
+         * The result does not depend on strategy or nthreads
+         *
+         * Bounded-latency limits (0 = unlimited):
+         *   max_candidates: keep only the best max_candidates
+         *       edges of each gen particle (fixed-size heap per row)
+         *   max_pairs: stop after max_pairs pair evaluations,
+         *       rounded down to whole gen particles in pT order, at nReco
+         *       evaluations each. So the highest-pT gen particles are 
+         *       always evaluated, and the result does not depend on
+         *       strategy or nthreads (GRID evaluates fewer pairs for 
+         *       the same gen particles)
+         * get_truncation() reports whether either limit kicked in.
+         * With limits the graph, and so the matching, is an approximation.
+         *
+         * Particles outside the acceptance of params have no edges.
+         * reco_jetpt and gen_jetpt are the jet pTs for the pT fraction
+         * cut; 0 disables it
+         */
+        void build(
+                const std::vector<simon::particle>& recoparts,
+                const std::vector<simon::particle>& genparts,
+                const PerFlavorMatchParams& params,
+                const double max_chisq,
+                const Strategy strategy = BRUTEFORCE,
+                const unsigned nthreads = 1,
+                const size_t max_candidates = 0,
+                const size_t max_pairs = 0,
+                const double reco_jetpt = 0,
+                const double gen_jetpt = 0);
+
+        /*
+         * GRID build against all the gen particles of an event,
+         * reusing the grid, pT order and flavor classes of a GenIndex
+         * instead of recomputing them. 
+         * Gen indices in the graph refer to genindex.event_particles()
+         */
+        void build(
+                const std::vector<simon::particle>& recoparts,
+                const GenIndex& genindex,
+                const PerFlavorMatchParams& params,
+                const double max_chisq,
+                const size_t max_candidates = 0,
+                const size_t max_pairs = 0);
+
+        size_t nReco() const {
+            return reco_rank.size();
+        }
+        size_t nGen() const {
+            return gen_row.size();
+        }
+        size_t nEdges() const {
+            return edges.size();
+        }
+
+        //edges of gen particle iGen
+        const edge* begin(const size_t iGen) const {
+            return edges.data() + row_start[gen_row[iGen]];
+        }
+        const edge* end(const size_t iGen) const {
+            return edges.data() + row_start[gen_row[iGen]+1];
+        }
+
+        //gen particles in the acceptance, in decreasing pT order
+        const std::vector<size_t>& gen_ptorder() const {
+            return gen_order;
+        }
+
+        //position of a reco particle in decreasing pT order
+        size_t get_reco_rank(const size_t iReco) const {
+            return reco_rank[iReco];
+        }
+
+        const truncationinfo& get_truncation() const {
+            return truncation;
+        }
+
+        void fill_info(const edge& theedge,
+                       const size_t iGen,
+                       matchinfovec& infos) const;
+
+    private:
+        //rows are stored in gen pT order,
+        //followed by one empty row shared by the gen particles
+        //outside the acceptance
+        std::vector<size_t> row_start;
+        std::vector<edge> edges;
+
+        std::vector<size_t> gen_order;
+        std::vector<size_t> gen_row;
+        std::vector<size_t> reco_rank;
+
+        //for filling matchinfo
+        std::vector<double> reco_dRlim;
+        std::vector<double> reco_pt;
+        std::vector<uint8_t> reco_flavor;
+        std::vector<double> gen_pt;
+
+        truncationinfo truncation;
+
+        //genindex may be nullptr
+        void build_impl(
+                const std::vector<simon::particle>& recoparts,
+                const std::vector<simon::particle>& genparts,
+                const PerFlavorMatchParams& params,
+                const double max_chisq,
+                const Strategy strategy,
+                const unsigned nthreads,
+                const size_t max_candidates,
+                const size_t max_pairs,
+                const double reco_jetpt,
+                const double gen_jetpt,
+                const GenIndex* genindex);
+    };
+
+    /*
+     * Greedy assignment: gen particles in decreasing pT order each take
+     * their best (lowest chisq) reco candidate that is still free.
+     * This is the standard algorithm of TrackMatcher::matchParticles()
+     * and gives identical results.
+     * infos may be nullptr
+     */
+    void assign_greedy(
+            const CandidateGraph& graph,
+            matchvec& matches,
+            matchinfovec* infos = nullptr);
+
+    /*
+     * Global greedy assignment: all edges are taken in increasing
+     * chisq order, and each is accepted if neither particle is
+     * matched yet (ties go to the higher-pT gen, then reco particle).
+     * The matches are returned in that order.
+     * infos may be nullptr
+     */
+    void assign_global_greedy(
+            const CandidateGraph& graph,
+            matchvec& matches,
+            matchinfovec* infos = nullptr);
+};
+
+#endif
@@ -25,6 +25,20 @@ namespace matching {
                         const double phi2,
                         const int charge2) const;
 
+        //resolutions of particle 1, as used in evaluate()
+        double pt_resolution(const double pt,
+                             const double eta,
+                             const double phi,
+                             const int charge) const {
+            return ptresfunc->evaluate(pt, eta, phi, charge);
+        }
+        double ang_resolution(const double pt,
+                              const double eta,
+                              const double phi,
+                              const int charge) const {
+            return angresfunc->evaluate(pt, eta, phi, charge);
+        }
+
     private:
         const ResFuncPtr ptresfunc, angresfunc;
         const double opp_charge_penalty, no_charge_penalty;
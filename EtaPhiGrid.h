@@ -0,0 +1,152 @@
+#ifndef SROTHMAN_MATCHING_V2_ETAPHIGRID_H
+#define SROTHMAN_MATCHING_V2_ETAPHIGRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace matching {
+    /*
+     * Uniform (eta, phi) grid over a collection of objects,
+     * used to find all objects within some dR of a point
+     * without scanning the whole collection
+     *
+     * The cells are at least min_cellsize wide in both eta and phi,
+     * so a query with radius <= min_cellsize only touches 3x3 cells.
+     * phi wraps around. The number of cells is capped at MAX_ETA_CELLS
+     * and MAX_PHI_CELLS (by widening the cells) so that the grid stays
+     * small for tiny radii.
+     *
+     * The objects are stored in CSR form: one contiguous array of
+     * indices, sorted by cell, plus the offset of each cell
+     */
+    class EtaPhiGrid {
+    public:
+        static constexpr int MAX_ETA_CELLS = 256;
+        static constexpr int MAX_PHI_CELLS = 256;
+
+        EtaPhiGrid() :
+            eta_min(0), eta_cellsize(1), phi_cellsize(2*M_PI),
+            neta(0), nphi(0) {}
+
+        template <typename T>
+        void build(const std::vector<T>& objects, const double min_cellsize){
+            cell_start.clear();
+            items.clear();
+            neta = 0;
+            nphi = 0;
+            if(objects.empty()){
+                return;
+            }
+
+            double eta_max = objects[0].eta;
+            eta_min = objects[0].eta;
+            for(const auto& obj : objects){
+                eta_min = std::min(eta_min, obj.eta);
+                eta_max = std::max(eta_max, obj.eta);
+            }
+
+            const double cellsize = std::max(min_cellsize, 1e-6);
+
+            neta = std::min<int>(MAX_ETA_CELLS,
+                    static_cast<int>((eta_max - eta_min)/cellsize) + 1);
+            eta_cellsize = std::max(cellsize, (eta_max - eta_min)/neta);
+            nphi = std::max(1, std::min<int>(MAX_PHI_CELLS,
+                        static_cast<int>(2*M_PI/cellsize)));
+            phi_cellsize = 2*M_PI/nphi;
+
+            std::vector<int> cells(objects.size());
+            cell_start.assign(neta*nphi+1, 0);
+            for(size_t i=0; i<objects.size(); ++i){
+                cells[i] = get_cell(get_ieta(objects[i].eta),
+                                    get_iphi(objects[i].phi));
+                ++cell_start[cells[i]+1];
+            }
+            for(size_t c=1; c<cell_start.size(); ++c){
+                cell_start[c] += cell_start[c-1];
+            }
+
+            items.resize(objects.size());
+            std::vector<size_t> fill(cell_start.begin(), cell_start.end()-1);
+            for(size_t i=0; i<objects.size(); ++i){
+                items[fill[cells[i]]++] = i;
+            }
+        }
+
+        /*
+         * Calls f(index) for every object in the cells overlapping
+         * the square of half-width radius around (eta, phi)
+         * The caller still needs to apply the actual dR cut
+         */
+        template <typename F>
+        void for_each_near(const double eta, const double phi,
+                           const double query_radius, F&& f) const {
+            if(neta == 0){
+                return;
+            }
+
+            //pad slightly so that rounding in the binning
+            //can never lose an object right at the edge
+            const double radius = query_radius + 1e-9;
+
+            //bin edges are computed in floating point and clamped
+            //before conversion, so that huge radii cannot overflow
+            const double eta_lo = std::floor((eta - radius - eta_min)/eta_cellsize);
+            const double eta_hi = std::floor((eta + radius - eta_min)/eta_cellsize);
+            if(eta_hi < 0 || eta_lo >= neta){
+                return;
+            }
+            const int ieta_lo = static_cast<int>(std::max(eta_lo, 0.0));
+            const int ieta_hi = static_cast<int>(std::min(eta_hi, neta-1.0));
+
+            int iphi_lo = 0;
+            int iphi_hi = nphi-1;
+            if(2*radius < 2*M_PI - phi_cellsize){
+                const double phi0 = normalize_phi(phi) + M_PI;
+                iphi_lo = static_cast<int>(std::floor((phi0 - radius)/phi_cellsize));
+                iphi_hi = static_cast<int>(std::floor((phi0 + radius)/phi_cellsize));
+                if(iphi_hi - iphi_lo + 1 >= nphi){
+                    iphi_lo = 0;
+                    iphi_hi = nphi-1;
+                }
+            }
+
+            for(int ieta = ieta_lo; ieta <= ieta_hi; ++ieta){
+                for(int iphi = iphi_lo; iphi <= iphi_hi; ++iphi){
+                    const int cell = get_cell(ieta, ((iphi % nphi) + nphi) % nphi);
+                    for(size_t k=cell_start[cell]; k<cell_start[cell+1]; ++k){
+                        f(items[k]);
+                    }
+                }
+            }
+        }
+
+    private:
+        double eta_min, eta_cellsize, phi_cellsize;
+        int neta, nphi;
+
+        std::vector<size_t> cell_start;
+        std::vector<size_t> items;
+
+        static double normalize_phi(const double phi){
+            //into [-pi, pi)
+            return phi - 2*M_PI*std::floor((phi + M_PI)/(2*M_PI));
+        }
+
+        int get_ieta(const double eta) const {
+            int ieta = static_cast<int>((eta - eta_min)/eta_cellsize);
+            return std::min(std::max(ieta, 0), neta-1);
+        }
+
+        int get_iphi(const double phi) const {
+            int iphi = static_cast<int>((normalize_phi(phi) + M_PI)/phi_cellsize);
+            return std::min(std::max(iphi, 0), nphi-1);
+        }
+
+        int get_cell(const int ieta, const int iphi) const {
+            return ieta*nphi + iphi;
+        }
+    };
+};
+
+#endif
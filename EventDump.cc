@@ -0,0 +1,311 @@
+#include "EventDump.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char MAGIC[8] = "PMFDUMP";
+static constexpr uint32_t VERSION = 2;
+
+//magic and version, followed by the configuration
+static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t);
+
+//smallest possible size of each record in the file
+static constexpr size_t JET_SIZE = 3*sizeof(double) + sizeof(uint32_t);
+static constexpr size_t PARTICLE_SIZE = 3*sizeof(double) + 2*sizeof(int32_t);
+static constexpr size_t MATCH_SIZE = 2*sizeof(uint32_t);
+
+template <typename T>
+static void append(std::vector<char>& buffer, const T& value){
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes+sizeof(T));
+}
+
+static void append_jets(std::vector<char>& buffer,
+                        const std::vector<simon::jet>& jets){
+    for(const auto& jet : jets){
+        append<double>(buffer, jet.pt);
+        append<double>(buffer, jet.eta);
+        append<double>(buffer, jet.phi);
+        append<uint32_t>(buffer, jet.particles.size());
+        for(const auto& part : jet.particles){
+            append<double>(buffer, part.pt);
+            append<double>(buffer, part.eta);
+            append<double>(buffer, part.phi);
+            append<int32_t>(buffer, part.pdgid);
+            append<int32_t>(buffer, part.charge);
+        }
+    }
+}
+
+static void append_matches(std::vector<char>& buffer,
+                           const matching::matchvec& matches,
+                           const size_t begin,
+                           const size_t end){
+    append<uint32_t>(buffer, end-begin);
+    for(size_t i=begin; i<end; ++i){
+        append<uint32_t>(buffer, matches[i].iReco);
+        append<uint32_t>(buffer, matches[i].iGen);
+    }
+}
+
+matching::EventDumpWriter::EventDumpWriter(
+        const std::string& path,
+        const std::string& config) :
+    file(std::fopen(path.c_str(), "wb")),
+    config(config),
+    mutex(),
+    buffer() {
+
+    if(!file){
+        throw std::runtime_error("EventDumpWriter: cannot open " + path);
+    }
+
+    const uint32_t nConfig = config.size();
+    try{
+        write(MAGIC, sizeof(MAGIC));
+        write(&VERSION, sizeof(VERSION));
+        write(&nConfig, sizeof(nConfig));
+        write(config.data(), config.size());
+    } catch(...){
+        std::fclose(file);
+        throw;
+    }
+}
+
+matching::EventDumpWriter::~EventDumpWriter() {
+    if(file){
+        std::fclose(file);
+    }
+}
+
+void matching::EventDumpWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(!file){
+        return;
+    }
+    const int result = std::fclose(file);
+    file = nullptr;
+    if(result != 0){
+        throw std::runtime_error("EventDumpWriter: close failed");
+    }
+}
+
+void matching::EventDumpWriter::write(
+        const void* src,
+        const size_t nbytes) {
+    if(!file){
+        throw std::runtime_error("EventDumpWriter: write after close");
+    }
+    if(std::fwrite(src, 1, nbytes, file) != nbytes){
+        throw std::runtime_error("EventDumpWriter: write failed");
+    }
+}
+
+void matching::EventDumpWriter::write_event(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        const matchvec& jetmatches){
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    buffer.clear();
+    append<uint32_t>(buffer, recojets.size());
+    append<uint32_t>(buffer, genjets.size());
+    append_jets(buffer, recojets);
+    append_jets(buffer, genjets);
+    append_matches(buffer, jetmatches, 0, jetmatches.size());
+    append<uint32_t>(buffer, 0);
+
+    write(buffer.data(), buffer.size());
+}
+
+void matching::EventDumpWriter::write_event(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        const eventresult& result){
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    buffer.clear();
+    append<uint32_t>(buffer, recojets.size());
+    append<uint32_t>(buffer, genjets.size());
+    append_jets(buffer, recojets);
+    append_jets(buffer, genjets);
+    append_matches(buffer, result.jetmatches, 0, result.jetmatches.size());
+    append<uint32_t>(buffer, 1);
+    for(size_t iJetMatch=0; iJetMatch<result.jetmatches.size(); ++iJetMatch){
+        append_matches(buffer, result.particlematches,
+                       result.offsets[iJetMatch],
+                       result.offsets[iJetMatch+1]);
+    }
+
+    write(buffer.data(), buffer.size());
+}
+
+matching::EventDumpReader::EventDumpReader(const std::string& path) :
+    data(nullptr),
+    size(0),
+    pos(0),
+    header_size(HEADER_SIZE),
+    config() {
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("EventDumpReader: cannot open " + path);
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE){
+        close(fd);
+        throw std::runtime_error("EventDumpReader: invalid dump file " + path);
+    }
+    size = st.st_size;
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        throw std::runtime_error("EventDumpReader: cannot mmap " + path);
+    }
+    data = static_cast<const char*>(mapped);
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    if(std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0){
+        munmap(mapped, size);
+        throw std::runtime_error("EventDumpReader: bad magic in " + path);
+    }
+    uint32_t version;
+    std::memcpy(&version, data+sizeof(MAGIC), sizeof(version));
+    if(version != VERSION){
+        munmap(mapped, size);
+        throw std::runtime_error("EventDumpReader: unsupported version in " + path);
+    }
+
+    try{
+        pos = HEADER_SIZE;
+        uint32_t nConfig;
+        read(&nConfig, sizeof(nConfig));
+        check_remaining(nConfig, 1);
+        config.assign(data+pos, nConfig);
+        header_size = pos + nConfig;
+    } catch(...){
+        munmap(mapped, size);
+        throw;
+    }
+
+    rewind();
+}
+
+matching::EventDumpReader::~EventDumpReader() {
+    munmap(const_cast<char*>(data), size);
+}
+
+void matching::EventDumpReader::rewind() {
+    pos = header_size;
+}
+
+void matching::EventDumpReader::read(void* dest, const size_t nbytes) {
+    check_remaining(1, nbytes);
+    std::memcpy(dest, data+pos, nbytes);
+    pos += nbytes;
+}
+
+//called before sizing anything from a count read from the file,
+//so that a corrupt count cannot cause a huge allocation
+void matching::EventDumpReader::check_remaining(
+        const size_t count,
+        const size_t record_size) const {
+    if(count > (size - pos) / record_size){
+        throw std::runtime_error("EventDumpReader: truncated dump file");
+    }
+}
+
+void matching::EventDumpReader::read_jets(
+        const size_t njets,
+        std::vector<simon::jet>& jets) {
+
+    check_remaining(njets, JET_SIZE);
+    jets.resize(njets);
+    for(auto& jet : jets){
+        uint32_t nPart;
+        read(&jet.pt, sizeof(double));
+        read(&jet.eta, sizeof(double));
+        read(&jet.phi, sizeof(double));
+        read(&nPart, sizeof(nPart));
+
+        check_remaining(nPart, PARTICLE_SIZE);
+        jet.nPart = nPart;
+        jet.particles.resize(nPart);
+        for(auto& part : jet.particles){
+            int32_t pdgid, charge;
+            read(&part.pt, sizeof(double));
+            read(&part.eta, sizeof(double));
+            read(&part.phi, sizeof(double));
+            read(&pdgid, sizeof(pdgid));
+            read(&charge, sizeof(charge));
+            part.pdgid = pdgid;
+            part.charge = charge;
+        }
+    }
+}
+
+void matching::EventDumpReader::read_matches(
+        const size_t nmatches,
+        matchvec& matches) {
+
+    check_remaining(nmatches, MATCH_SIZE);
+    matches.reserve(matches.size() + nmatches);
+    for(size_t i=0; i<nmatches; ++i){
+        uint32_t iReco, iGen;
+        read(&iReco, sizeof(iReco));
+        read(&iGen, sizeof(iGen));
+        matches.emplace_back(iReco, iGen);
+    }
+}
+
+bool matching::EventDumpReader::next(
+        std::vector<simon::jet>& recojets,
+        std::vector<simon::jet>& genjets) {
+
+    eventresult recorded;
+    return next(recojets, genjets, recorded);
+}
+
+bool matching::EventDumpReader::next(
+        std::vector<simon::jet>& recojets,
+        std::vector<simon::jet>& genjets,
+        eventresult& recorded) {
+
+    recorded.clear();
+
+    if(pos >= size){
+        return false;
+    }
+
+    uint32_t nReco, nGen;
+    read(&nReco, sizeof(nReco));
+    read(&nGen, sizeof(nGen));
+    read_jets(nReco, recojets);
+    read_jets(nGen, genjets);
+
+    uint32_t nJetMatches, hasParticleMatches;
+    read(&nJetMatches, sizeof(nJetMatches));
+    read_matches(nJetMatches, recorded.jetmatches);
+    read(&hasParticleMatches, sizeof(hasParticleMatches));
+    if(hasParticleMatches){
+        recorded.offsets.push_back(0);
+        for(uint32_t iJetMatch=0; iJetMatch<nJetMatches; ++iJetMatch){
+            uint32_t nMatches;
+            read(&nMatches, sizeof(nMatches));
+            read_matches(nMatches, recorded.particlematches);
+            recorded.offsets.push_back(recorded.particlematches.size());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,124 @@
+#ifndef SROTHMAN_MATCHING_V2_EVENTDUMP_H
+#define SROTHMAN_MATCHING_V2_EVENTDUMP_H
+
+#include "SRothman/SimonTools/src/jet.h"
+#include "MatchTypes.h"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Compact binary dump of the reco and gen jets seen by the matcher,
+ * with the configuration of the matcher and the matches it produced,
+ * so that events can be replayed (and the matches checked) outside 
+ * the framework
+ *
+ * Layout (native byte order, no padding):
+ *   header:   char[8] magic = "PMFDUMP", uint32 version,
+ *             uint32 nConfig, then nConfig chars of matcher
+ *             configuration (TrackMatcher::getConfig())
+ *   event:    uint32 nRecoJets, uint32 nGenJets,
+ *             then nRecoJets + nGenJets jets,
+ *             uint32 nJetMatches, then nJetMatches matches,
+ *             uint32 hasParticleMatches, and if it is not 0, 
+ *             for each jet match uint32 nMatches, then nMatches matches
+ *   jet:      double pt, eta, phi, uint32 nPart,
+ *             then nPart particles
+ *   particle: double pt, eta, phi, int32 pdgid, int32 charge
+ *   match:    uint32 iReco, uint32 iGen
+ *
+ * Only the quantities used by the matching are stored
+ */
+namespace matching {
+    class EventDumpWriter {
+    public:
+        //config is the configuration of the recording matcher
+        EventDumpWriter(const std::string& path,
+                        const std::string& config);
+        //closes the file if close() was not called,
+        //but cannot report a failure
+        ~EventDumpWriter();
+
+        EventDumpWriter(const EventDumpWriter&) = delete;
+        EventDumpWriter& operator=(const EventDumpWriter&) = delete;
+
+        const std::string& get_config() const {
+            return config;
+        }
+
+        //safe to call from multiple threads
+        //jet matches only (matchJets())
+        void write_event(
+                const std::vector<simon::jet>& recojets,
+                const std::vector<simon::jet>& genjets,
+                const matchvec& jetmatches);
+
+        //jet and particle matches (matchEvent())
+        void write_event(
+                const std::vector<simon::jet>& recojets,
+                const std::vector<simon::jet>& genjets,
+                const eventresult& result);
+
+        //flushes and closes the file; throws if that fails
+        //no more events can be written afterwards
+        void close();
+
+    private:
+        FILE* file;
+        const std::string config;
+        std::mutex mutex;
+        std::vector<char> buffer;
+
+        //throws if the file is closed or the write fails
+        void write(const void* src, const size_t nbytes);
+    };
+
+    class EventDumpReader {
+    public:
+        explicit EventDumpReader(const std::string& path);
+        ~EventDumpReader();
+
+        EventDumpReader(const EventDumpReader&) = delete;
+        EventDumpReader& operator=(const EventDumpReader&) = delete;
+
+        //returns false once all events have been read
+        bool next(std::vector<simon::jet>& recojets,
+                  std::vector<simon::jet>& genjets);
+
+        /*
+         * Also returns the recorded matches in recorded.jetmatches,
+         * and, if the event was recorded by matchEvent(), the 
+         * particle matches in recorded.particlematches with their 
+         * recorded.offsets (otherwise offsets is left empty)
+         * The matchinfos are not recorded
+         */
+        bool next(std::vector<simon::jet>& recojets,
+                  std::vector<simon::jet>& genjets,
+                  eventresult& recorded);
+
+        //configuration of the recording matcher 
+        const std::string& get_config() const {
+            return config;
+        }
+
+        void rewind();
+
+    private:
+        const char* data;
+        size_t size;
+        size_t pos;
+        size_t header_size;
+        std::string config;
+
+        void read(void* dest, const size_t nbytes);
+        //throws unless count records of record_size bytes are left
+        void check_remaining(const size_t count, 
+                             const size_t record_size) const;
+        void read_jets(const size_t njets, std::vector<simon::jet>& jets);
+        void read_matches(const size_t nmatches, matchvec& matches);
+    };
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "GenIndex.h"
+#include "MatchHelpers.h"
+
+matching::GenIndex::GenIndex() :
+    jets(nullptr),
+    params(nullptr),
+    jet_order(),
+    particle_orders(),
+    jet_start(1, 0),
+    classes(),
+    parts(),
+    part_jet(),
+    part_order(),
+    grid() {}
+
+void matching::GenIndex::build(
+        const std::vector<simon::jet>& genjets,
+        const PerFlavorMatchParams& params){
+    MATCHING_TRACE_SCOPE("gen index");
+
+    this->jets = &genjets;
+    this->params = &params;
+
+    detail::get_ptorder(genjets, jet_order);
+
+    particle_orders.resize(genjets.size());
+    jet_start.assign(1, 0);
+    parts.clear();
+    part_jet.clear();
+    for(size_t iJet=0; iJet<genjets.size(); ++iJet){
+        const auto& jetparts = genjets[iJet].particles;
+        detail::get_ptorder(jetparts, particle_orders[iJet]);
+        detail::apply_acceptance(jetparts, params, genjets[iJet].pt,
+                                 particle_orders[iJet]);
+
+        parts.insert(parts.end(), jetparts.begin(), jetparts.end());
+        part_jet.insert(part_jet.end(), jetparts.size(), iJet);
+        jet_start.push_back(parts.size());
+    }
+    detail::get_ptorder(parts, part_order);
+    if(params.has_acceptance_cuts()){
+        part_order.erase(
+                std::remove_if(part_order.begin(), part_order.end(),
+                    [&](size_t iPart){
+                        return !params.accepts(parts[iPart], 
+                                               genjets[part_jet[iPart]].pt);
+                    }),
+                part_order.end());
+    }
+
+    //the grid only needs to be roughly matched to the dR limits,
+    //so the limits of the gen particles' own flavor are a good proxy
+    double cellsize = MIN_GRID_CELLSIZE;
+    classes.resize(parts.size());
+    for(size_t iPart=0; iPart<parts.size(); ++iPart){
+        const auto& part = parts[iPart];
+
+        uint8_t mask = 0;
+        for(unsigned flavor=0; flavor<PerFlavorMatchParams::NFLAVORS; ++flavor){
+            const auto* theparms = params.get_params(
+                    static_cast<PerFlavorMatchParams::Flavor>(flavor));
+            if(theparms && theparms->flavor_filter->evaluate(
+                        part.charge, part.pdgid)){
+                mask |= 1u << flavor;
+            }
+        }
+        classes[iPart] = mask;
+
+        const auto* ownparms = params.get_params(part);
+        if(ownparms){
+            cellsize = std::max(cellsize, ownparms->dR_limiter->evaluate(
+                        part.pt, part.eta, part.phi));
+        }
+    }
+    grid.build(parts, cellsize);
+}
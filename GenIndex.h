@@ -0,0 +1,106 @@
+#ifndef SROTHMAN_MATCHING_V2_GENINDEX_H
+#define SROTHMAN_MATCHING_V2_GENINDEX_H
+
+#include "SRothman/SimonTools/src/jet.h"
+#include "PerFlavorMatchParams.h"
+#include "EtaPhiGrid.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace matching {
+    /*
+     * Gen-side preprocessing of one event, built once with
+     * TrackMatcher::buildGenIndex() and then reused to match
+     * any number of reco collections against the same gen jets
+     *
+     * Holds:
+     *   the pT order of the gen jets
+     *   the pT order of the particles in each gen jet, 
+     *       without the particles outside the acceptance
+     *   the flavor classes of each gen particle: bit f is set if the
+     *       gen particle passes the FlavorFilter of reco flavor f
+     *   all the gen particles of the event in one collection, 
+     *       with their pT order (again without the particles outside
+     *       the acceptance) and an (eta, phi) grid over them
+     *
+     * The index keeps pointers to the gen jets and to the matcher 
+     * configuration it was built with, so it must not outlive either of
+     * them, and can only be used with the TrackMatcher that built it.
+     * Changing the matcher's acceptance invalidates the index.
+     * Once built the index is read-only and can be shared between threads.
+     */
+    class GenIndex {
+    public:
+        GenIndex();
+
+        void build(const std::vector<simon::jet>& genjets,
+                   const PerFlavorMatchParams& params);
+
+        const std::vector<simon::jet>& get_jets() const {
+            return *jets;
+        }
+
+        const std::vector<size_t>& jet_ptorder() const {
+            return jet_order;
+        }
+
+        //indices into genjets[iJet].particles
+        const std::vector<size_t>& particle_ptorder(const size_t iJet) const {
+            return particle_orders[iJet];
+        }
+
+        //flavor classes of the particles of gen jet iJet
+        const uint8_t* flavor_classes(const size_t iJet) const {
+            return classes.data() + jet_start[iJet];
+        }
+
+        bool built_with(const PerFlavorMatchParams& params) const {
+            return this->params == &params;
+        }
+
+        /*
+         * Event-level view: the particles of all the gen jets, 
+         * concatenated in jet order
+         */
+        const std::vector<simon::particle>& event_particles() const {
+            return parts;
+        }
+        const std::vector<size_t>& event_ptorder() const {
+            return part_order;
+        }
+        const uint8_t* event_flavor_classes() const {
+            return classes.data();
+        }
+        const EtaPhiGrid& event_grid() const {
+            return grid;
+        }
+        size_t jet_of(const size_t iEventPart) const {
+            return part_jet[iEventPart];
+        }
+        size_t constituent_of(const size_t iEventPart) const {
+            return iEventPart - jet_start[part_jet[iEventPart]];
+        }
+
+        //grid cells are never made narrower than this
+        static constexpr double MIN_GRID_CELLSIZE = 0.01;
+
+    private:
+        const std::vector<simon::jet>* jets;
+        const PerFlavorMatchParams* params;
+
+        std::vector<size_t> jet_order;
+        std::vector<std::vector<size_t>> particle_orders;
+
+        //offset of each jet in the event-level arrays
+        std::vector<size_t> jet_start;
+        std::vector<uint8_t> classes;
+
+        std::vector<simon::particle> parts;
+        std::vector<size_t> part_jet;
+        std::vector<size_t> part_order;
+        EtaPhiGrid grid;
+    };
+};
+
+#endif
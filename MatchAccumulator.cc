@@ -0,0 +1,190 @@
+#include "MatchAccumulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+static void check_edges(const std::vector<double>& edges){
+    if(edges.size() < 2){
+        throw std::invalid_argument("MatchSummary needs at least one bin");
+    }
+    if(!std::is_sorted(edges.begin(), edges.end())){
+        throw std::invalid_argument("MatchSummary bin edges must be sorted");
+    }
+}
+
+static int find_bin_1d(const std::vector<double>& edges, const double value){
+    if(!(value >= edges.front()) || value >= edges.back()){
+        return -1;
+    }
+    return std::upper_bound(edges.begin(), edges.end(), value) - edges.begin() - 1;
+}
+
+matching::MatchSummary::MatchSummary(
+        const std::vector<double>& pt_edges,
+        const std::vector<double>& abseta_edges) :
+    pt_edges(pt_edges),
+    abseta_edges(abseta_edges),
+    bins() {
+
+    check_edges(pt_edges);
+    check_edges(abseta_edges);
+    bins.resize(PerFlavorMatchParams::NFLAVORS * nPtBins() * nEtaBins());
+}
+
+matching::MatchSummary::bin* matching::MatchSummary::find_bin(
+        const simon::particle& part){
+    int ipt = find_bin_1d(pt_edges, part.pt);
+    int ieta = find_bin_1d(abseta_edges, std::abs(part.eta));
+    if(ipt < 0 || ieta < 0){
+        return nullptr;
+    }
+    return &bins[get_index(PerFlavorMatchParams::get_flavor(part), ipt, ieta)];
+}
+
+void matching::MatchSummary::accumulate(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const matchvec& matches,
+        const matchinfovec& infos){
+
+    for(const auto& gen : genjet.particles){
+        bin* thebin = find_bin(gen);
+        if(thebin){
+            thebin->nGen += 1;
+        }
+    }
+    for(const auto& reco : recojet.particles){
+        bin* thebin = find_bin(reco);
+        if(thebin){
+            thebin->nReco += 1;
+        }
+    }
+
+    for(size_t iMatch=0; iMatch<matches.size(); ++iMatch){
+        const auto& gen = genjet.particles[matches[iMatch].iGen];
+        const auto& reco = recojet.particles[matches[iMatch].iReco];
+        const auto& info = infos[iMatch];
+
+        bin* genbin = find_bin(gen);
+        if(genbin){
+            double response = info.ptresidual / gen.pt;
+            genbin->nGenMatched += 1;
+            genbin->sum_response += response;
+            genbin->sum_response2 += response*response;
+            genbin->sum_dR += info.dR;
+        }
+
+        bin* recobin = find_bin(reco);
+        if(recobin){
+            recobin->nRecoMatched += 1;
+        }
+    }
+}
+
+void matching::MatchSummary::merge(const MatchSummary& other){
+    if(other.pt_edges != pt_edges || other.abseta_edges != abseta_edges){
+        throw std::invalid_argument("Cannot merge MatchSummary objects with different binning");
+    }
+
+    for(size_t i=0; i<bins.size(); ++i){
+        bins[i].nGen += other.bins[i].nGen;
+        bins[i].nGenMatched += other.bins[i].nGenMatched;
+        bins[i].nReco += other.bins[i].nReco;
+        bins[i].nRecoMatched += other.bins[i].nRecoMatched;
+        bins[i].sum_response += other.bins[i].sum_response;
+        bins[i].sum_response2 += other.bins[i].sum_response2;
+        bins[i].sum_dR += other.bins[i].sum_dR;
+    }
+}
+
+void matching::MatchSummary::clear(){
+    std::fill(bins.begin(), bins.end(), bin());
+}
+
+//0 for an empty denominator, so that empty bins give no NaN
+static double safe_ratio(const double num, const double den){
+    return den > 0 ? num / den : 0;
+}
+
+//"-" for an empty bin
+static const char* format_value(char* buf, const size_t size,
+                                const double value, const double count){
+    if(count > 0){
+        snprintf(buf, size, "%.4f", value);
+    } else {
+        snprintf(buf, size, "-");
+    }
+    return buf;
+}
+
+double matching::MatchSummary::efficiency(
+        const PerFlavorMatchParams::Flavor flavor,
+        const size_t ipt,
+        const size_t ieta) const {
+    const auto& thebin = get_bin(flavor, ipt, ieta);
+    return safe_ratio(thebin.nGenMatched, thebin.nGen);
+}
+
+double matching::MatchSummary::purity(
+        const PerFlavorMatchParams::Flavor flavor,
+        const size_t ipt,
+        const size_t ieta) const {
+    const auto& thebin = get_bin(flavor, ipt, ieta);
+    return safe_ratio(thebin.nRecoMatched, thebin.nReco);
+}
+
+double matching::MatchSummary::mean_response(
+        const PerFlavorMatchParams::Flavor flavor,
+        const size_t ipt,
+        const size_t ieta) const {
+    const auto& thebin = get_bin(flavor, ipt, ieta);
+    return safe_ratio(thebin.sum_response, thebin.nGenMatched);
+}
+
+double matching::MatchSummary::response_resolution(
+        const PerFlavorMatchParams::Flavor flavor,
+        const size_t ipt,
+        const size_t ieta) const {
+    const auto& thebin = get_bin(flavor, ipt, ieta);
+    double mean = safe_ratio(thebin.sum_response, thebin.nGenMatched);
+    double var = safe_ratio(thebin.sum_response2, thebin.nGenMatched) - mean*mean;
+    return std::sqrt(std::max(var, 0.0));
+}
+
+void matching::MatchSummary::print() const {
+    static const char* names[PerFlavorMatchParams::NFLAVORS] = {
+        "ELE", "MU", "HADCH", "PHO", "HAD0"
+    };
+
+    printf("MatchSummary:\n");
+    for(unsigned flavor=0; flavor<PerFlavorMatchParams::NFLAVORS; ++flavor){
+        for(size_t ipt=0; ipt<nPtBins(); ++ipt){
+            for(size_t ieta=0; ieta<nEtaBins(); ++ieta){
+                const auto& thebin = bins[get_index(flavor, ipt, ieta)];
+                if(thebin.nGen == 0 && thebin.nReco == 0){
+                    continue;
+                }
+                auto F = static_cast<PerFlavorMatchParams::Flavor>(flavor);
+                char eff[32], pur[32], resp[32], res[32];
+                printf("\t%s pt [%g, %g) |eta| [%g, %g): "
+                       "eff %s (%g gen), purity %s (%g reco), "
+                       "response %s +- %s\n",
+                       names[flavor],
+                       pt_edges[ipt], pt_edges[ipt+1],
+                       abseta_edges[ieta], abseta_edges[ieta+1],
+                       format_value(eff, sizeof(eff), 
+                                    efficiency(F, ipt, ieta), thebin.nGen), 
+                       thebin.nGen,
+                       format_value(pur, sizeof(pur), 
+                                    purity(F, ipt, ieta), thebin.nReco), 
+                       thebin.nReco,
+                       format_value(resp, sizeof(resp), 
+                                    mean_response(F, ipt, ieta), thebin.nGenMatched),
+                       format_value(res, sizeof(res), 
+                                    response_resolution(F, ipt, ieta), thebin.nGenMatched));
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHACCUMULATOR_H
+#define SROTHMAN_MATCHING_V2_MATCHACCUMULATOR_H
+
+#include "SRothman/SimonTools/src/jet.h"
+#include "PerFlavorMatchParams.h"
+#include "MatchTypes.h"
+
+#include <vector>
+
+namespace matching {
+    /*
+     * Interface for consumers of the particle matching that only need
+     * aggregate quantities. TrackMatcher::matchParticles() can feed
+     * the matches of each jet straight into an accumulator,
+     * without materializing a transfer matrix.
+     *
+     * An accumulator is not thread-safe; use one per thread
+     * and combine them at the end.
+     */
+    class MatchAccumulator {
+    public:
+        virtual void accumulate(
+                const simon::jet& recojet,
+                const simon::jet& genjet,
+                const matchvec& matches,
+                const matchinfovec& infos) = 0;
+
+        virtual ~MatchAccumulator() = default;
+    };
+
+    /*
+     * Matching performance summary binned in pT, |eta| and flavor
+     *
+     * Gen particles are binned in their own pT, |eta| and flavor,
+     *     giving the matching efficiency and the pT response
+     *     (reco pT - gen pT)/gen pT and dR of the matched pairs
+     * Reco particles are binned in their own pT, |eta| and flavor,
+     *     giving the matching purity (1 - fake rate)
+     *
+     * Particles outside the bin edges are not counted
+     */
+    class MatchSummary : public MatchAccumulator {
+    public:
+        struct bin {
+            double nGen = 0;
+            double nGenMatched = 0;
+            double nReco = 0;
+            double nRecoMatched = 0;
+            double sum_response = 0;
+            double sum_response2 = 0;
+            double sum_dR = 0;
+        };
+
+        MatchSummary(const std::vector<double>& pt_edges,
+                     const std::vector<double>& abseta_edges);
+
+        void accumulate(
+                const simon::jet& recojet,
+                const simon::jet& genjet,
+                const matchvec& matches,
+                const matchinfovec& infos) override;
+
+        //add the contents of another summary with the same binning
+        void merge(const MatchSummary& other);
+
+        void clear();
+
+        size_t nPtBins() const {
+            return pt_edges.size()-1;
+        }
+        size_t nEtaBins() const {
+            return abseta_edges.size()-1;
+        }
+
+        const bin& get_bin(const PerFlavorMatchParams::Flavor flavor,
+                           const size_t ipt,
+                           const size_t ieta) const {
+            return bins[get_index(flavor, ipt, ieta)];
+        }
+
+        //0 for an empty bin (no gen, reco or matched gen particles
+        //respectively; the counts are in get_bin())
+        double efficiency(const PerFlavorMatchParams::Flavor flavor,
+                          const size_t ipt,
+                          const size_t ieta) const;
+        double purity(const PerFlavorMatchParams::Flavor flavor,
+                      const size_t ipt,
+                      const size_t ieta) const;
+        double mean_response(const PerFlavorMatchParams::Flavor flavor,
+                             const size_t ipt,
+                             const size_t ieta) const;
+        double response_resolution(const PerFlavorMatchParams::Flavor flavor,
+                                   const size_t ipt,
+                                   const size_t ieta) const;
+
+        void print() const;
+
+    private:
+        const std::vector<double> pt_edges;
+        const std::vector<double> abseta_edges;
+        std::vector<bin> bins;
+
+        size_t get_index(const unsigned flavor,
+                         const size_t ipt,
+                         const size_t ieta) const {
+            return (flavor*nPtBins() + ipt)*nEtaBins() + ieta;
+        }
+
+        //returns nullptr if outside the binning
+        bin* find_bin(const simon::particle& part);
+    };
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "MatchCostModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+matching::MatchCostModel::MatchCostModel() :
+    MatchCostModel(3, 2.5, 400, 30000) {}
+
+matching::MatchCostModel::MatchCostModel(
+        const double pair_ns,
+        const double graph_pair_ns,
+        const double grid_particle_ns,
+        const double thread_ns) :
+    pair_ns(pair_ns),
+    graph_pair_ns(graph_pair_ns),
+    grid_particle_ns(grid_particle_ns),
+    thread_ns(thread_ns) {}
+
+double matching::MatchCostModel::estimate(
+        const Strategy strategy,
+        const size_t nReco,
+        const size_t nGen,
+        const double max_dRlim,
+        const double area,
+        const unsigned nthreads) const {
+    const double npairs = static_cast<double>(nReco) * nGen;
+
+    switch(strategy){
+        case SEQUENTIAL:
+            return pair_ns * npairs;
+        case GRID: {
+            const double reach = 9*max_dRlim*max_dRlim;
+            const double fraction = area > 0 ? std::min(1.0, reach/area) : 1.0;
+            return grid_particle_ns * (nReco + nGen) 
+                 + graph_pair_ns * npairs * fraction;
+        }
+        case PARALLEL:
+            return thread_ns * nthreads
+                 + graph_pair_ns * npairs / std::max(nthreads, 1u);
+    }
+    throw std::invalid_argument("MatchCostModel: invalid strategy");
+}
+
+matching::MatchCostModel::Strategy matching::MatchCostModel::choose(
+        const size_t nReco,
+        const size_t nGen,
+        const double max_dRlim,
+        const double area,
+        const unsigned nthreads) const {
+
+    Strategy best = SEQUENTIAL;
+    double best_cost = estimate(SEQUENTIAL, nReco, nGen, max_dRlim, area, nthreads);
+
+    double cost = estimate(GRID, nReco, nGen, max_dRlim, area, nthreads);
+    if(cost < best_cost){
+        best = GRID;
+        best_cost = cost;
+    }
+
+    if(nthreads > 1 && nGen > 1){
+        cost = estimate(PARALLEL, nReco, nGen, max_dRlim, area, nthreads);
+        if(cost < best_cost){
+            best = PARALLEL;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+double matching::MatchCostModel::get_area(
+        const std::vector<simon::particle>& parts){
+    if(parts.empty()){
+        return 0;
+    }
+
+    //phi is measured relative to the first particle,
+    //so that jets straddling phi = +-pi are handled
+    const double phi0 = parts[0].phi;
+    double eta_min = parts[0].eta, eta_max = parts[0].eta;
+    double dphi_min = 0, dphi_max = 0;
+    for(const auto& part : parts){
+        eta_min = std::min(eta_min, part.eta);
+        eta_max = std::max(eta_max, part.eta);
+
+        double dphi = part.phi - phi0;
+        dphi -= 2*M_PI*std::floor((dphi + M_PI)/(2*M_PI));
+        dphi_min = std::min(dphi_min, dphi);
+        dphi_max = std::max(dphi_max, dphi);
+    }
+    return (eta_max - eta_min) * (dphi_max - dphi_min);
+}
+
+void matching::MatchCostModel::save(const std::string& path) const {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if(!file){
+        throw std::runtime_error("MatchCostModel: cannot open " + path);
+    }
+    fprintf(file, "pair_ns %.17g\n", pair_ns);
+    fprintf(file, "graph_pair_ns %.17g\n", graph_pair_ns);
+    fprintf(file, "grid_particle_ns %.17g\n", grid_particle_ns);
+    fprintf(file, "thread_ns %.17g\n", thread_ns);
+    std::fclose(file);
+}
+
+matching::MatchCostModel matching::MatchCostModel::load(const std::string& path){
+    FILE* file = std::fopen(path.c_str(), "r");
+    if(!file){
+        throw std::runtime_error("MatchCostModel: cannot open " + path);
+    }
+
+    MatchCostModel model;
+    char name[64];
+    double value;
+    int nread;
+    //one bit per coefficient, in the order of save()
+    unsigned found = 0;
+    while((nread = fscanf(file, "%63s %lf", name, &value)) == 2){
+        if(std::strcmp(name, "pair_ns") == 0){
+            model.pair_ns = value;
+            found |= 1;
+        } else if(std::strcmp(name, "graph_pair_ns") == 0){
+            model.graph_pair_ns = value;
+            found |= 2;
+        } else if(std::strcmp(name, "grid_particle_ns") == 0){
+            model.grid_particle_ns = value;
+            found |= 4;
+        } else if(std::strcmp(name, "thread_ns") == 0){
+            model.thread_ns = value;
+            found |= 8;
+        } else {
+            std::fclose(file);
+            throw std::runtime_error("MatchCostModel: unknown coefficient " 
+                                     + std::string(name) + " in " + path);
+        }
+    }
+    std::fclose(file);
+    if(nread != EOF){
+        throw std::runtime_error("MatchCostModel: cannot parse " + path);
+    }
+    if(found != 15){
+        throw std::runtime_error("MatchCostModel: missing coefficient in " + path);
+    }
+    return model;
+}
+
+void matching::MatchCostModel::print() const {
+    printf("MatchCostModel:\n");
+    printf("\tpair_ns = %g\n", pair_ns);
+    printf("\tgraph_pair_ns = %g\n", graph_pair_ns);
+    printf("\tgrid_particle_ns = %g\n", grid_particle_ns);
+    printf("\tthread_ns = %g\n", thread_ns);
+}
@@ -0,0 +1,75 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHCOSTMODEL_H
+#define SROTHMAN_MATCHING_V2_MATCHCOSTMODEL_H
+
+#include "SRothman/SimonTools/src/jet.h"
+
+#include <string>
+#include <vector>
+
+namespace matching {
+    /*
+     * Cost model used by TrackMatcher to pick the candidate
+     * generation strategy of each particle matching call
+     *
+     * Estimated times (ns) for nReco x nGen particles:
+     *   SEQUENTIAL: pair_ns * nReco*nGen
+     *   GRID:       grid_particle_ns * (nReco+nGen) 
+     *             + graph_pair_ns * nReco*nGen * f
+     *       where f is the fraction of the gen particles within 
+     *       the 3x3 grid cells (of size max dR limit) around a reco 
+     *       particle, assuming they are spread uniformly over the 
+     *       (eta, phi) bounding box of the gen particles
+     *   PARALLEL:   thread_ns * nthreads 
+     *             + graph_pair_ns * nReco*nGen / nthreads
+     *
+     * The coefficients can be measured on the running machine with
+     * TrackMatcher::calibrateCostModel(), and saved to/loaded from a 
+     * plain text file with one "name value" pair per line
+     */
+    class MatchCostModel {
+    public:
+        enum Strategy {
+            SEQUENTIAL=0,
+            GRID=1,
+            PARALLEL=2
+        };
+
+        //rough defaults for a current x86 core
+        MatchCostModel();
+
+        MatchCostModel(const double pair_ns,
+                       const double graph_pair_ns,
+                       const double grid_particle_ns,
+                       const double thread_ns);
+
+        double estimate(const Strategy strategy,
+                        const size_t nReco,
+                        const size_t nGen,
+                        const double max_dRlim,
+                        const double area,
+                        const unsigned nthreads) const;
+
+        //nthreads <= 1 never chooses PARALLEL
+        Strategy choose(const size_t nReco,
+                        const size_t nGen,
+                        const double max_dRlim,
+                        const double area,
+                        const unsigned nthreads) const;
+
+        //(eta, phi) bounding box area of a particle collection
+        static double get_area(const std::vector<simon::particle>& parts);
+
+        void save(const std::string& path) const;
+        //throws unless the file sets every coefficient
+        static MatchCostModel load(const std::string& path);
+
+        void print() const;
+
+        double pair_ns;
+        double graph_pair_ns;
+        double grid_particle_ns;
+        double thread_ns;
+    };
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHHELPERS_H
+#define SROTHMAN_MATCHING_V2_MATCHHELPERS_H
+
+#include "PerFlavorMatchParams.h"
+#include "MatchTypes.h"
+#include "Tracing.h"
+#include "SRothman/SimonTools/src/deltaR.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+/*
+ * Building blocks shared by the different matching implementations
+ * Not part of the public interface
+ */
+namespace matching {
+    namespace detail {
+        /*
+         * Decreasing pT order
+         * Ties are broken by index, so that the order (and so the 
+         * matching) does not depend on the sorting algorithm
+         */
+        template <typename T>
+        void get_ptorder(const std::vector<T>& vec,
+                         std::vector<size_t>& ptorder){
+            MATCHING_TRACE_SCOPE("pT sort");
+
+            ptorder.resize(vec.size());
+            std::iota(ptorder.begin(), ptorder.end(), 0);
+            std::sort(ptorder.begin(), ptorder.end(),
+                    [&](size_t i1, size_t i2){
+                        if(vec[i1].pt != vec[i2].pt){
+                            return vec[i1].pt > vec[i2].pt;
+                        }
+                        return i1 < i2;
+                    });
+        }
+
+        /*
+         * Same order as get_ptorder(), for collections of at most
+         * N (a power of two) objects, with a bitonic sorting network 
+         * on the stack instead of std::sort
+         */
+        template <size_t N, typename T>
+        void get_ptorder_network(const std::vector<T>& vec,
+                                 size_t* ptorder){
+            static_assert((N & (N-1)) == 0, "N must be a power of two");
+
+            struct key {
+                double pt;
+                size_t idx;
+            };
+            auto before = [](const key& k1, const key& k2){
+                if(k1.pt != k2.pt){
+                    return k1.pt > k2.pt;
+                }
+                return k1.idx < k2.idx;
+            };
+
+            const size_t n = vec.size();
+            size_t npad = 1;
+            while(npad < n){
+                npad <<= 1;
+            }
+
+            //padding sorts to the end
+            key keys[N];
+            for(size_t i=0; i<npad; ++i){
+                keys[i].pt = i < n ? vec[i].pt : -std::numeric_limits<double>::infinity();
+                keys[i].idx = i;
+            }
+
+            for(size_t k=2; k<=npad; k<<=1){
+                for(size_t j=k>>1; j>0; j>>=1){
+                    for(size_t i=0; i<npad; ++i){
+                        const size_t l = i^j;
+                        if(l <= i) continue;
+
+                        const bool ascending = (i & k) == 0;
+                        if(before(keys[l], keys[i]) == ascending){
+                            std::swap(keys[i], keys[l]);
+                        }
+                    }
+                }
+            }
+
+            for(size_t i=0; i<n; ++i){
+                ptorder[i] = keys[i].idx;
+            }
+        }
+
+        /*
+         * Removes the particles outside the acceptance from a pT order
+         * jetpt = 0 disables the pT fraction cut
+         */
+        template <typename T>
+        void apply_acceptance(
+                const std::vector<T>& vec,
+                const PerFlavorMatchParams& particle_params,
+                const double jetpt,
+                std::vector<size_t>& ptorder){
+            if(!particle_params.has_acceptance_cuts()){
+                return;
+            }
+
+            ptorder.erase(
+                    std::remove_if(ptorder.begin(), ptorder.end(),
+                        [&](size_t i){
+                            return !particle_params.accepts(vec[i], jetpt);
+                        }),
+                    ptorder.end());
+        }
+
+        /*
+         * Per-reco-particle quantities that do not depend on the gen particle
+         * Reco particles whose flavor is configured as "DoNotMatch",
+         * or that are outside the acceptance, are removed from 
+         * reco_ptorder when the index is built
+         * jetpt = 0 disables the pT fraction cut
+         */
+        struct reco_index {
+            std::vector<const MatchParams*> params;
+            std::vector<double> dRlim;
+            std::vector<uint8_t> flavor;
+        };
+
+        template <typename T>
+        void build_reco_index(
+                const std::vector<T>& recovec,
+                const PerFlavorMatchParams& particle_params,
+                const double jetpt,
+                std::vector<size_t>& reco_ptorder,
+                reco_index& index){
+            MATCHING_TRACE_SCOPE("reco index");
+
+            index.params.resize(recovec.size());
+            index.dRlim.resize(recovec.size());
+            index.flavor.resize(recovec.size());
+            for(size_t iReco=0; iReco<recovec.size(); ++iReco){
+                const auto& reco = recovec[iReco];
+                const auto flavor = PerFlavorMatchParams::get_flavor(reco);
+                const auto* theparms = particle_params.get_params(flavor);
+                index.params[iReco] = theparms;
+                index.flavor[iReco] = flavor;
+                if(theparms){
+                    index.dRlim[iReco] = theparms->dR_limiter->evaluate(
+                            reco.pt, reco.eta, reco.phi);
+                }
+            }
+
+            const bool cuts = particle_params.has_acceptance_cuts();
+            reco_ptorder.erase(
+                    std::remove_if(reco_ptorder.begin(), reco_ptorder.end(),
+                        [&](size_t iReco){
+                            return index.params[iReco] == nullptr
+                                || (cuts && !particle_params.accepts(
+                                            recovec[iReco], jetpt));
+                        }),
+                    reco_ptorder.end());
+        }
+
+        /*
+         * Number of matchable reco particles (the ones that
+         * build_reco_index() keeps) and their largest dR limit,
+         * for the cost model, without building the reco_index
+         */
+        template <typename T>
+        void get_reco_extent(
+                const std::vector<T>& recovec,
+                const PerFlavorMatchParams& particle_params,
+                const double jetpt,
+                size_t& nActive,
+                double& max_dRlim){
+            const bool cuts = particle_params.has_acceptance_cuts();
+            nActive = 0;
+            max_dRlim = 0;
+            for(const auto& reco : recovec){
+                const auto flavor = PerFlavorMatchParams::get_flavor(reco);
+                const auto* theparms = particle_params.get_params(flavor);
+                if(!theparms) continue;
+                if(cuts && !particle_params.accepts(reco, jetpt)) continue;
+
+                ++nActive;
+                max_dRlim = std::max(max_dRlim, 
+                        theparms->dR_limiter->evaluate(reco.pt, reco.eta, reco.phi));
+            }
+        }
+
+        template <typename T>
+        void fill_info(const T& reco, const T& gen,
+                       const double chisq, const double dR,
+                       const double dRlim,
+                       matchinfovec& infos){
+            infos.emplace_back(
+                    chisq, dR, dRlim,
+                    reco.pt - gen.pt,
+                    PerFlavorMatchParams::get_flavor(reco));
+        }
+
+        /*
+         * Evaluates one (reco, gen) pair
+         * Returns false if the pair is not admissible (dR or filters),
+         * otherwise fills dR and chisq
+         * check_flavor = false skips the FlavorFilter, for callers that
+         * have already applied it through the GenIndex flavor classes
+         */
+        template <typename T>
+        inline bool evaluate_pair(
+                const T& reco, const T& gen,
+                const MatchParams& theparms,
+                const double dRlim,
+                double& dR, double& chisq,
+                const bool check_flavor = true){
+
+            dR = simon::deltaR(gen.eta, gen.phi,
+                               reco.eta, reco.phi);
+            if(dR > dRlim) return false;
+
+            if(!theparms.charge_filter->evaluate(
+                    reco.charge, gen.charge)) return false;
+
+            if(check_flavor && !theparms.flavor_filter->evaluate(
+                    gen.charge,
+                    gen.pdgid)) return false;
+
+            chisq = theparms.chi_sq_fn.evaluate(
+                    reco.pt, reco.eta, 
+                    reco.phi, reco.charge,
+                    gen.pt, gen.eta, 
+                    gen.phi, gen.charge);
+            return true;
+        }
+    };
+};
+
+#endif
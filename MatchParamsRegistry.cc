@@ -0,0 +1,147 @@
+#include "MatchParamsRegistry.h"
+#include "PerFlavorMatchParams.h"
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+    struct entry {
+        matching::MatchParamsRegistry::config cfg;
+        std::weak_ptr<const matching::MatchParams> params;
+    };
+
+    struct registry {
+        std::mutex mutex;
+        std::unordered_multimap<uint64_t, entry> entries;
+    };
+
+    //constructed on first use, so that it is safe to use
+    //from the constructors of other static objects
+    registry& get_registry(){
+        static registry reg;
+        return reg;
+    }
+
+    constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    void hash_bytes(uint64_t& h, const void* data, const size_t n){
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(size_t i=0; i<n; ++i){
+            h ^= bytes[i];
+            h *= FNV_PRIME;
+        }
+    }
+
+    void hash_double(uint64_t& h, const double value){
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash_bytes(h, &bits, sizeof(bits));
+    }
+
+    void hash_string(uint64_t& h, const std::string& value){
+        //length first, so that ("ab", "c") != ("a", "bc")
+        const uint64_t len = value.size();
+        hash_bytes(h, &len, sizeof(len));
+        hash_bytes(h, value.data(), value.size());
+    }
+
+    bool same_double(const double d1, const double d2){
+        return std::memcmp(&d1, &d2, sizeof(double)) == 0;
+    }
+};
+
+uint64_t matching::MatchParamsRegistry::config::hash() const noexcept {
+    uint64_t h = FNV_OFFSET;
+    hash_string(h, dr_mode);
+    hash_double(h, dr_param1);
+    hash_double(h, dr_param2);
+    hash_double(h, dr_param3);
+    hash_string(h, ptres_mode);
+    hash_double(h, ptres_param1);
+    hash_double(h, ptres_param2);
+    hash_string(h, angres_mode);
+    hash_double(h, angres_param1);
+    hash_double(h, angres_param2);
+    hash_double(h, opp_charge_penalty);
+    hash_double(h, no_charge_penalty);
+    hash_string(h, charge_filter_mode);
+    hash_string(h, flavor_filter_mode);
+    return h;
+}
+
+bool matching::MatchParamsRegistry::config::operator==(
+        const config& other) const noexcept {
+    return dr_mode == other.dr_mode
+        && same_double(dr_param1, other.dr_param1)
+        && same_double(dr_param2, other.dr_param2)
+        && same_double(dr_param3, other.dr_param3)
+        && ptres_mode == other.ptres_mode
+        && same_double(ptres_param1, other.ptres_param1)
+        && same_double(ptres_param2, other.ptres_param2)
+        && angres_mode == other.angres_mode
+        && same_double(angres_param1, other.angres_param1)
+        && same_double(angres_param2, other.angres_param2)
+        && same_double(opp_charge_penalty, other.opp_charge_penalty)
+        && same_double(no_charge_penalty, other.no_charge_penalty)
+        && charge_filter_mode == other.charge_filter_mode
+        && flavor_filter_mode == other.flavor_filter_mode;
+}
+
+std::shared_ptr<const matching::MatchParams> matching::MatchParamsRegistry::get(
+        const config& cfg){
+    const uint64_t h = cfg.hash();
+
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    auto range = reg.entries.equal_range(h);
+    for(auto it = range.first; it != range.second; ++it){
+        auto params = it->second.params.lock();
+        if(params && it->second.cfg == cfg){
+            return params;
+        }
+    }
+
+    //inserts are rare (one per new configuration), so this is 
+    //where the expired entries under every hash are dropped
+    for(auto it = reg.entries.begin(); it != reg.entries.end(); ){
+        if(it->second.params.expired()){
+            it = reg.entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    auto params = std::make_shared<const MatchParams>(
+            cfg.dr_mode,
+            cfg.dr_param1,
+            cfg.dr_param2,
+            cfg.dr_param3,
+            cfg.ptres_mode,
+            cfg.ptres_param1,
+            cfg.ptres_param2,
+            cfg.angres_mode,
+            cfg.angres_param1,
+            cfg.angres_param2,
+            cfg.opp_charge_penalty,
+            cfg.no_charge_penalty,
+            cfg.charge_filter_mode,
+            cfg.flavor_filter_mode);
+    reg.entries.emplace(h, entry{cfg, params});
+    return params;
+}
+
+size_t matching::MatchParamsRegistry::size(){
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    size_t n = 0;
+    for(const auto& it : reg.entries){
+        if(!it.second.params.expired()){
+            ++n;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,63 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHPARAMSREGISTRY_H
+#define SROTHMAN_MATCHING_V2_MATCHPARAMSREGISTRY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace matching {
+    class MatchParams;
+
+    /*
+     * Process-wide registry of compiled MatchParams
+     *
+     * A MatchParams (dR limiter, chisq function with its resolution
+     * functions, charge and flavor filters) is immutable once built, 
+     * so every TrackMatcher and thread with the same configuration
+     * can share one copy. get() looks the configuration up by its 
+     * content hash (the full configuration is compared on a hit, 
+     * so hash collisions are harmless) and only builds a new 
+     * MatchParams if no live one exists.
+     *
+     * The registry holds weak references: a configuration is freed
+     * when the last matcher using it goes away, and its entry is 
+     * dropped the next time a new configuration is added.
+     * get() is thread-safe.
+     */
+    class MatchParamsRegistry {
+    public:
+        struct config {
+            //dR_limiter params
+            std::string dr_mode;
+            double dr_param1 = 0;
+            double dr_param2 = 0;
+            double dr_param3 = 0;
+            //chi_sq_fn params
+            std::string ptres_mode;
+            double ptres_param1 = 0;
+            double ptres_param2 = 0;
+            std::string angres_mode;
+            double angres_param1 = 0;
+            double angres_param2 = 0;
+            double opp_charge_penalty = 0;
+            double no_charge_penalty = 0;
+            //charge_filter params
+            std::string charge_filter_mode;
+            //flavor_filter params
+            std::string flavor_filter_mode;
+
+            //FNV-1a over the strings and the bit patterns of the doubles
+            uint64_t hash() const noexcept;
+
+            //bitwise on the doubles, consistent with hash()
+            bool operator==(const config& other) const noexcept;
+        };
+
+        static std::shared_ptr<const MatchParams> get(const config& cfg);
+
+        //number of configurations currently alive
+        static size_t size();
+    };
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHTYPES_H
+#define SROTHMAN_MATCHING_V2_MATCHTYPES_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace matching {
+    struct matchidxs {
+        size_t iReco, iGen;
+        matchidxs(size_t iReco, size_t iGen) : iReco(iReco), iGen(iGen) {}
+    };
+    using matchvec = std::vector<matchidxs>;
+
+    /*
+     * Optional extra information about each match,
+     * filled when the match is made so that it does not 
+     * need to be recomputed downstream
+     * Stored in a matchinfovec parallel to the matchvec
+     *
+     * For jet matches chisq is NaN, dRlimit is the jet dR threshold,
+     * and flavor is NOFLAVOR
+     */
+    struct matchinfo {
+        float chisq;
+        float dR;
+        float dRlimit;
+        float ptresidual; //reco pT - gen pT
+        uint8_t flavor;   //PerFlavorMatchParams::Flavor of the reco particle
+
+        static constexpr uint8_t NOFLAVOR = 255;
+
+        matchinfo(float chisq, float dR, float dRlimit, 
+                  float ptresidual, uint8_t flavor) :
+            chisq(chisq), dR(dR), dRlimit(dRlimit), 
+            ptresidual(ptresidual), flavor(flavor) {}
+    };
+    using matchinfovec = std::vector<matchinfo>;
+
+    //a matched pair of particles, identified by jet and constituent index
+    struct eventmatch {
+        size_t iRecoJet, iRecoPart;
+        size_t iGenJet, iGenPart;
+        eventmatch(size_t iRecoJet, size_t iRecoPart,
+                   size_t iGenJet, size_t iGenPart) :
+            iRecoJet(iRecoJet), iRecoPart(iRecoPart),
+            iGenJet(iGenJet), iGenPart(iGenPart) {}
+    };
+    using eventmatchvec = std::vector<eventmatch>;
+
+    /*
+     * Output of TrackMatcher::matchEvent(): the jet matches and the 
+     * particle matches of all the matched jet pairs, in contiguous arrays
+     *
+     * The particle matches of jetmatches[k] are 
+     *     particlematches[offsets[k]] ... particlematches[offsets[k+1]-1]
+     * with indices into the particles of those two jets, and 
+     * particleinfos parallel to particlematches
+     *
+     * Reusing the same eventresult for every event keeps its capacity,
+     * so that in steady state the outputs are not reallocated.
+     * The matching itself still allocates scratch space per call
+     * (the jet matching, and the particle matching of jet pairs 
+     * beyond TrackMatcher::SMALL_JET_CAPACITY or with candidate limits)
+     */
+    struct eventresult {
+        matchvec jetmatches;
+        matchinfovec jetinfos;
+
+        std::vector<size_t> offsets;
+        matchvec particlematches;
+        matchinfovec particleinfos;
+
+        size_t nParticleMatches(const size_t iJetMatch) const {
+            return offsets[iJetMatch+1] - offsets[iJetMatch];
+        }
+
+        void clear(){
+            jetmatches.clear();
+            jetinfos.clear();
+            offsets.clear();
+            particlematches.clear();
+            particleinfos.clear();
+        }
+    };
+
+    /*
+     * Reports whether the candidate search was truncated by the 
+     * bounded-latency limits (TrackMatcher::setCandidateLimits())
+     */
+    struct truncationinfo {
+        size_t nPairsEvaluated = 0;
+        //gen particles that lost candidates to the per-gen cap
+        size_t nGenTruncated = 0;
+        //total number of candidates dropped by the per-gen cap
+        size_t nCandidatesDropped = 0;
+        //the pair evaluation cap stopped the search early
+        bool pair_cap_hit = false;
+
+        bool truncated() const {
+            return nGenTruncated > 0 || pair_cap_hit;
+        }
+    };
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "MatchingPipeline.h"
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+static unsigned get_nworkers(const unsigned nworkers){
+    if(nworkers > 0){
+        return nworkers;
+    }
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+namespace {
+    /*
+     * Blocking wait for a stage of the pipeline
+     *
+     * wait_until(ready) spins on ready() for a bounded number of 
+     * iterations, and then sleeps on a condition variable until 
+     * ready() returns true. ready() may have side effects (e.g. 
+     * try_pop()), and is only ever called by the waiting thread.
+     * notify() must be called after every change that can make 
+     * ready() true. It is nearly free when nobody is sleeping.
+     */
+    class StageWaiter {
+    public:
+        static constexpr unsigned SPIN_ITERATIONS = 64;
+
+        StageWaiter() : nsleeping(0) {}
+
+        template <typename F>
+        void wait_until(F&& ready){
+            for(unsigned i=0; i<SPIN_ITERATIONS; ++i){
+                if(ready()){
+                    return;
+                }
+                std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            nsleeping.fetch_add(1, std::memory_order_seq_cst);
+            //pairs with the fence in notify(): either the notifier 
+            //sees us sleeping, or we see its change in ready()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cv.wait(lock, ready);
+            nsleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        void notify(){
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(nsleeping.load(std::memory_order_seq_cst) > 0){
+                std::lock_guard<std::mutex> lock(mutex);
+                cv.notify_all();
+            }
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<unsigned> nsleeping;
+    };
+};
+
+static matching::TrackMatcher get_worker_matcher(
+        const matching::TrackMatcher& matcher,
+        const bool worker_parallelism){
+    matching::TrackMatcher result(matcher);
+    if(!worker_parallelism){
+        result.setParallelism(0, 1);
+    }
+    return result;
+}
+
+matching::MatchingPipeline::MatchingPipeline(
+        const TrackMatcher& matcher,
+        const unsigned nworkers,
+        const size_t queue_capacity,
+        const bool worker_parallelism) :
+    matcher(get_worker_matcher(matcher, worker_parallelism)),
+    nworkers(get_nworkers(nworkers)),
+    queue_capacity(queue_capacity) {
+
+    if(queue_capacity == 0){
+        throw std::invalid_argument("MatchingPipeline queue_capacity must be > 0");
+    }
+}
+
+void matching::MatchingPipeline::process(
+        PipelineEvent& event,
+        PipelineResult& result) const {
+
+    result.sequence = event.sequence;
+
+    matcher.matchJets(event.recojets, event.genjets, result.jetmatches);
+
+    result.tmats.resize(result.jetmatches.size());
+    for(size_t iMatch=0; iMatch<result.jetmatches.size(); ++iMatch){
+        const auto& match = result.jetmatches[iMatch];
+        matcher.matchParticles(
+                event.recojets[match.iReco],
+                event.genjets[match.iGen],
+                result.tmats[iMatch]);
+    }
+
+    result.recojets = std::move(event.recojets);
+    result.genjets = std::move(event.genjets);
+}
+
+void matching::MatchingPipeline::run(
+        PipelineSource& source,
+        PipelineSink& sink){
+
+    BoundedQueue<PipelineEvent> inqueue(queue_capacity);
+    BoundedQueue<PipelineResult> outqueue(queue_capacity);
+
+    const size_t max_inflight = inqueue.capacity() + outqueue.capacity() + nworkers;
+
+    std::atomic<bool> source_done(false);
+    std::atomic<unsigned> workers_running(nworkers);
+    std::atomic<size_t> nwritten(0);
+
+    //one waiter per condition a stage can wait for
+    StageWaiter inqueue_space;   //reader, for a free slot in inqueue
+    StageWaiter inqueue_events;  //workers, for an event (or the end)
+    StageWaiter outqueue_space;  //workers, for a free slot in outqueue
+    StageWaiter outqueue_events; //writer, for a result (or the end)
+    StageWaiter inflight_space;  //reader, for events to be written
+
+    std::atomic<bool> abort(false);
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex;
+    auto fail = [&](){
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error){
+                error = std::current_exception();
+            }
+        }
+        abort.store(true);
+        inqueue_space.notify();
+        inqueue_events.notify();
+        outqueue_space.notify();
+        outqueue_events.notify();
+        inflight_space.notify();
+    };
+
+    auto reader = [&](){
+        try{
+            size_t sequence = 0;
+            while(!abort.load(std::memory_order_relaxed)){
+                //backpressure on the total number of events in flight
+                inflight_space.wait_until([&](){
+                    return abort.load(std::memory_order_relaxed)
+                        || sequence - nwritten.load(std::memory_order_acquire) < max_inflight;
+                });
+                if(abort.load(std::memory_order_relaxed)){
+                    break;
+                }
+
+                PipelineEvent event;
+                if(!source.next(event)){
+                    break;
+                }
+                event.sequence = sequence++;
+
+                bool pushed = false;
+                inqueue_space.wait_until([&](){
+                    pushed = inqueue.try_push(std::move(event));
+                    return pushed || abort.load(std::memory_order_relaxed);
+                });
+                if(!pushed){
+                    break;
+                }
+                inqueue_events.notify();
+            }
+        } catch(...){
+            fail();
+        }
+        source_done.store(true, std::memory_order_release);
+        inqueue_events.notify();
+    };
+
+    auto worker = [&](){
+        try{
+            PipelineEvent event;
+            PipelineResult result;
+            while(!abort.load(std::memory_order_relaxed)){
+                //only exit once the source is done
+                //AND the queue has been drained
+                bool popped = false;
+                bool finished = false;
+                inqueue_events.wait_until([&](){
+                    popped = inqueue.try_pop(event);
+                    if(!popped && source_done.load(std::memory_order_acquire)){
+                        popped = inqueue.try_pop(event);
+                        finished = !popped;
+                    }
+                    return popped || finished || abort.load(std::memory_order_relaxed);
+                });
+                if(!popped){
+                    break;
+                }
+                inqueue_space.notify();
+
+                process(event, result);
+
+                bool pushed = false;
+                outqueue_space.wait_until([&](){
+                    pushed = outqueue.try_push(std::move(result));
+                    return pushed || abort.load(std::memory_order_relaxed);
+                });
+                if(!pushed){
+                    break;
+                }
+                outqueue_events.notify();
+            }
+        } catch(...){
+            fail();
+        }
+        workers_running.fetch_sub(1, std::memory_order_release);
+        outqueue_events.notify();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nworkers+1);
+    try{
+        threads.emplace_back(reader);
+        for(unsigned iWorker=0; iWorker<nworkers; ++iWorker){
+            threads.emplace_back(worker);
+        }
+    } catch(...){
+        fail();
+    }
+
+    //writer stage in the calling thread
+    //results can arrive out of order, so we hold on to them
+    //until all preceeding events have been written
+    try{
+        std::map<size_t, PipelineResult> pending;
+        PipelineResult result;
+        size_t next = 0;
+        while(!abort.load(std::memory_order_relaxed)){
+            bool popped = false;
+            bool finished = false;
+            outqueue_events.wait_until([&](){
+                popped = outqueue.try_pop(result);
+                if(!popped && workers_running.load(std::memory_order_acquire) == 0){
+                    popped = outqueue.try_pop(result);
+                    finished = !popped;
+                }
+                return popped || finished || abort.load(std::memory_order_relaxed);
+            });
+            if(!popped){
+                break;
+            }
+            outqueue_space.notify();
+
+            pending.emplace(result.sequence, std::move(result));
+            auto it = pending.begin();
+            while(it != pending.end() && it->first == next){
+                sink.write(it->second);
+                it = pending.erase(it);
+                ++next;
+                nwritten.store(next, std::memory_order_release);
+                inflight_space.notify();
+            }
+        }
+    } catch(...){
+        fail();
+    }
+
+    for(auto& thread : threads){
+        thread.join();
+    }
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef SROTHMAN_MATCHING_V2_MATCHINGPIPELINE_H
+#define SROTHMAN_MATCHING_V2_MATCHINGPIPELINE_H
+
+#include "TrackMatcher.h"
+
+#include <vector>
+
+namespace matching {
+    struct PipelineEvent {
+        size_t sequence;
+        std::vector<simon::jet> recojets;
+        std::vector<simon::jet> genjets;
+    };
+
+    struct PipelineResult {
+        size_t sequence;
+        std::vector<simon::jet> recojets;
+        std::vector<simon::jet> genjets;
+
+        //output of matchJets()
+        matchvec jetmatches;
+        //output of matchParticles() for each entry in jetmatches
+        std::vector<Eigen::MatrixXd> tmats;
+    };
+
+    /*
+     * Producer stage
+     * next() fills the next event and returns false
+     * once the input is exhausted
+     */
+    class PipelineSource {
+    public:
+        virtual bool next(PipelineEvent& event) = 0;
+
+        virtual ~PipelineSource() = default;
+    };
+
+    /*
+     * Consumer stage
+     * write() is called once per event, in the order
+     * in which the events were produced by the source
+     */
+    class PipelineSink {
+    public:
+        virtual void write(PipelineResult& result) = 0;
+
+        virtual ~PipelineSink() = default;
+    };
+
+    /*
+     * Streaming read -> match -> write pipeline around a TrackMatcher
+     *
+     * The source runs in its own thread, the matching is done by
+     * nworkers threads, and the sink runs in the calling thread.
+     * The stages are connected by bounded lock-free queues of
+     * the given capacity. A full queue stalls the stage that feeds it,
+     * and the number of events in flight is capped at
+     * 2*queue_capacity + nworkers, so memory use is bounded
+     * even if one event is much slower than the others.
+     *
+     * A stage that finds its queue full (or empty) spins briefly and
+     * then blocks until the neighbouring stage makes progress, so idle
+     * stages (e.g. while the source is doing I/O) do not use any CPU.
+     *
+     * The source and sink are only ever called from one thread each.
+     * An exception thrown by any stage stops the pipeline
+     * and is rethrown from run().
+     *
+     * nworkers = 0 uses std::thread::hardware_concurrency()
+     *
+     * The workers use a copy of the matcher. By default the copy has
+     * the parallel path of TrackMatcher (setParallelism()) disabled, 
+     * since the workers already keep all the cores busy and each of 
+     * them splitting large jets across threads could start up to
+     * nworkers * parallel_nthreads threads. worker_parallelism = true
+     * keeps the matcher's own setting. A matcher that is recording
+     * (TrackMatcher::setRecorder()) cannot be reconfigured, so it 
+     * needs worker_parallelism = true; otherwise this throws
+     */
+    class MatchingPipeline {
+    public:
+        MatchingPipeline(
+                const TrackMatcher& matcher,
+                const unsigned nworkers,
+                const size_t queue_capacity,
+                const bool worker_parallelism = false);
+
+        void run(PipelineSource& source, PipelineSink& sink);
+
+    private:
+        TrackMatcher matcher;
+        const unsigned nworkers;
+        const size_t queue_capacity;
+
+        void process(PipelineEvent& event, PipelineResult& result) const;
+    };
+};
+
+#endif
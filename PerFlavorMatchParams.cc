@@ -36,12 +36,27 @@ matching::MatchParams::MatchParams(
     charge_filter(ChargeFilter::get_charge_filter(charge_filter_mode)),
     flavor_filter(FlavorFilter::get_flavor_filter(flavor_filter_mode)) {}
 
+static const char* const FLAVOR_NAMES[matching::PerFlavorMatchParams::NFLAVORS] = {
+    "ELE", "MU", "HADCH", "PHO", "HAD0"
+};
+
 matching::PerFlavorMatchParams::PerFlavorMatchParams() :
-    ele_params(nullptr),
-    mu_params(nullptr),
-    hadch_params(nullptr),
-    pho_params(nullptr),
-    had0_params(nullptr) {}
+    table(),
+    configured(),
+    configs(),
+    acceptance(),
+    any_acceptance_cuts(false) {
+    configured.fill(false);
+}
+
+void matching::PerFlavorMatchParams::check_flavor(Flavor flavor) const {
+    if(flavor < 0 || flavor >= NFLAVORS){
+        throw std::invalid_argument("Invalid flavor");
+    }
+    if(configured[flavor]){
+        throw std::invalid_argument("Flavor already set up");
+    }
+}
 
 void matching::PerFlavorMatchParams::setup_params(
         Flavor flavor,
@@ -63,12 +78,7 @@ void matching::PerFlavorMatchParams::setup_params(
         const std::string& charge_filter_mode,
         //flavor_filter params
         const std::string& flavor_filter_mode) {
-    auto& target = get_target(flavor);
-    if(target){
-        throw std::invalid_argument("Flavor already set up");
-    }
-
-    target = std::make_unique<const MatchParams>(
+    setup_params(flavor, {
             dr_mode,
             dr_param1,
             dr_param2,
@@ -82,84 +92,130 @@ void matching::PerFlavorMatchParams::setup_params(
             opp_charge_penalty,
             no_charge_penalty,
             charge_filter_mode,
-            flavor_filter_mode);
+            flavor_filter_mode});
 }
 
-const matching::MatchParams& matching::PerFlavorMatchParams::get_params(Flavor flavor) const {
-    auto& target = get_target(flavor);
-    if(!target){
-        printf("TRYING TO GET FLAVOR %d\n", flavor);
-        throw std::invalid_argument("Flavor not set up");
+void matching::PerFlavorMatchParams::setup_params(
+        Flavor flavor,
+        const MatchParamsRegistry::config& config) {
+    if(config.dr_mode == "DoNotMatch"){
+        setup_do_not_match(flavor);
+        return;
     }
-    return *target;
+
+    check_flavor(flavor);
+
+    table[flavor] = MatchParamsRegistry::get(config);
+    configs[flavor] = config;
+    configured[flavor] = true;
 }
 
-const matching::MatchParams& matching::PerFlavorMatchParams::get_params(const simon::particle& recopart) const {
-    Flavor flavor;
-    if(recopart.pdgid == 11){
-        flavor = ELE;
-    } else if(recopart.pdgid == 13){
-        flavor = MU;
-    } else if(recopart.pdgid == 22){
-        flavor = PHO;
-    } else if(recopart.charge !=0){
-        flavor = HADCH;
-    } else {
-        flavor = HAD0;
-    } 
-    return get_params(flavor);
+void matching::PerFlavorMatchParams::setup_do_not_match(Flavor flavor) {
+    check_flavor(flavor);
+
+    table[flavor] = nullptr;
+    configs[flavor] = MatchParamsRegistry::config();
+    configs[flavor].dr_mode = "DoNotMatch";
+    configured[flavor] = true;
 }
 
-matching::MatchParamsPtr& matching::PerFlavorMatchParams::get_target(Flavor flavor) {
-    switch(flavor){
-        case ELE:
-            return ele_params;
-        case MU:
-            return mu_params;
-        case HADCH:
-            return hadch_params;
-        case PHO:
-            return pho_params;
-        case HAD0:
-            return had0_params;
-        default:
-            throw std::invalid_argument("Invalid flavor");
+void matching::PerFlavorMatchParams::set_acceptance(
+        Flavor flavor,
+        const Acceptance& acceptance) {
+    if(flavor < 0 || flavor >= NFLAVORS){
+        throw std::invalid_argument("Invalid flavor");
+    }
+    //written this way to also reject NaN
+    if(!(acceptance.min_pt >= 0) || !(acceptance.max_pt >= 0)
+            || !(acceptance.max_abseta >= 0) || !(acceptance.min_ptfrac >= 0)){
+        throw std::invalid_argument("Acceptance cuts must be >= 0");
+    }
+    //an inverted window would silently drop every particle of the flavor
+    if(acceptance.max_pt > 0 && acceptance.max_pt < acceptance.min_pt){
+        throw std::invalid_argument("Acceptance max_pt must be >= min_pt");
+    }
+
+    this->acceptance[flavor] = acceptance;
+
+    any_acceptance_cuts = false;
+    for(const auto& acc : this->acceptance){
+        any_acceptance_cuts = any_acceptance_cuts || acc.has_cuts();
     }
 }
 
-const matching::MatchParamsPtr& matching::PerFlavorMatchParams::get_target(Flavor flavor) const {
-    switch(flavor){
-        case ELE:
-            return ele_params;
-        case MU:
-            return mu_params;
-        case HADCH:
-            return hadch_params;
-        case PHO:
-            return pho_params;
-        case HAD0:
-            return had0_params;
-        default:
-            throw std::invalid_argument("Invalid flavor");
+void matching::PerFlavorMatchParams::validate() const {
+    for(unsigned flavor=0; flavor<NFLAVORS; ++flavor){
+        if(!configured[flavor]){
+            throw std::invalid_argument(
+                    std::string("Flavor not set up: ") + FLAVOR_NAMES[flavor]);
+        }
     }
 }
 
 void matching::PerFlavorMatchParams::print_status() const {
     printf("PerFlavorMatchParams::status():\n");
-    printf("\tELE: %s\n", ele_params ? "set" : "not set");
-    printf("\tMU: %s\n", mu_params ? "set" : "not set");
-    printf("\tHADCH: %s\n", hadch_params ? "set" : "not set");
-    printf("\tPHO: %s\n", pho_params ? "set" : "not set");
-    printf("\tHAD0: %s\n", had0_params ? "set" : "not set");
+    for(unsigned flavor=0; flavor<NFLAVORS; ++flavor){
+        const char* status = "not set";
+        if(table[flavor]){
+            status = "set";
+        } else if(configured[flavor]){
+            status = "do not match";
+        }
+        printf("\t%s: %s\n", FLAVOR_NAMES[flavor], status);
+        const auto& acc = acceptance[flavor];
+        if(acc.has_cuts()){
+            printf("\t\tacceptance: min_pt %g, max_pt %g, max_abseta %g, min_ptfrac %g\n",
+                   acc.min_pt, acc.max_pt, acc.max_abseta, acc.min_ptfrac);
+        }
+    }
 }
 
 
 #ifdef CMSSW_GIT_HASH
 
-matching::MatchParams::MatchParams(
-        const edm::ParameterSet& params):
-    MatchParams(
-            params.getParameter<std::string>("dr_mode"),
+void matching::MatchParams::fillPSetDescription(edm::ParameterSetDescription& desc) {
+    desc.add<std::string>("dr_mode");
+    //not needed when dr_mode = "DoNotMatch",
+    //required otherwise (getParameter() throws if one is missing)
+    desc.addOptional<double>("dr_param1");
+    desc.addOptional<double>("dr_param2");
+    desc.addOptional<double>("dr_param3");
+    desc.addOptional<std::string>("ptres_mode");
+    desc.addOptional<double>("ptres_param1");
+    desc.addOptional<double>("ptres_param2");
+    desc.addOptional<std::string>("angres_mode");
+    desc.addOptional<double>("angres_param1");
+    desc.addOptional<double>("angres_param2");
+    desc.addOptional<double>("opp_charge_penalty");
+    desc.addOptional<double>("no_charge_penalty");
+    desc.addOptional<std::string>("charge_filter_mode");
+    desc.addOptional<std::string>("flavor_filter_mode");
+    //acceptance, 0 = no cut
+    desc.add<double>("min_pt", 0);
+    desc.add<double>("max_pt", 0);
+    desc.add<double>("max_abseta", 0);
+    desc.add<double>("min_ptfrac", 0);
+}
+
+void matching::PerFlavorMatchParams::setup_params(
+        Flavor flavor,
+        const edm::ParameterSet& params) {
+    Acceptance acc;
+    acc.min_pt = params.getParameter<double>("min_pt");
+    acc.max_pt = params.getParameter<double>("max_pt");
+    acc.max_abseta = params.getParameter<double>("max_abseta");
+    acc.min_ptfrac = params.getParameter<double>("min_ptfrac");
+    set_acceptance(flavor, acc);
+
+    const std::string dr_mode = params.getParameter<std::string>("dr_mode");
+    if(dr_mode == "DoNotMatch"){
+        setup_do_not_match(flavor);
+        return;
+    }
+
+    setup_params(
+            flavor,
+            dr_mode,
             params.getParameter<double>("dr_param1"),
             params.getParameter<double>("dr_param2"),
             params.getParameter<double>("dr_param3"),
@@ -172,33 +228,7 @@ matching::MatchParams::MatchParams(
             params.getParameter<double>("opp_charge_penalty"),
             params.getParameter<double>("no_charge_penalty"),
             params.getParameter<std::string>("charge_filter_mode"),
-            params.getParameter<std::string>("flavor_filter_mode")) {}
-
-void matching::MatchParams::fillPSetDescription(edm::ParameterSetDescription& desc) {
-    desc.add<std::string>("dr_mode");
-    desc.add<double>("dr_param1");
-    desc.add<double>("dr_param2");
-    desc.add<double>("dr_param3");
-    desc.add<std::string>("ptres_mode");
-    desc.add<double>("ptres_param1");
-    desc.add<double>("ptres_param2");
-    desc.add<std::string>("angres_mode");
-    desc.add<double>("angres_param1");
-    desc.add<double>("angres_param2");
-    desc.add<double>("opp_charge_penalty");
-    desc.add<double>("no_charge_penalty");
-    desc.add<std::string>("charge_filter_mode");
-    desc.add<std::string>("flavor_filter_mode");
-}
-
-void matching::PerFlavorMatchParams::setup_params(
-        Flavor flavor,
-        const edm::ParameterSet& params) {
-    auto& target = get_target(flavor);
-    if(target){
-        throw std::invalid_argument("Flavor already set up");
-    }
-    target = std::make_unique<const MatchParams>(params);
+            params.getParameter<std::string>("flavor_filter_mode"));
 }
 
 #endif
@@ -5,6 +5,11 @@
 #include "ChiSqFn.h"
 #include "ChargeFilter.h"
 #include "FlavorFilter.h"
+#include "MatchParamsRegistry.h"
+
+#include <array>
+#include <cmath>
+#include <memory>
 
 #ifdef CMSSW_GIT_HASH
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
@@ -40,15 +45,61 @@ namespace matching{
         const FlavorFilterPtr flavor_filter;
 
 #ifdef CMSSW_GIT_HASH
-        MatchParams(
-            const edm::ParameterSet& params);
-
         static void fillPSetDescription(edm::ParameterSetDescription& desc);
 #endif
     };
 
-    using MatchParamsPtr = std::unique_ptr<const MatchParams>;
+    //shared between matchers with the same configuration,
+    //see MatchParamsRegistry
+    using MatchParamsPtr = std::shared_ptr<const MatchParams>;
+
+    /*
+     * Kinematic acceptance of one particle flavor
+     *
+     * Particles outside the acceptance are dropped before any 
+     * (reco, gen) pair is formed, and so are always unmatched.
+     * The same cuts apply to reco and gen particles of the flavor.
+     * A value of 0 disables each cut. Negative or NaN values, and
+     * max_pt < min_pt, are rejected by set_acceptance()
+     */
+    struct Acceptance {
+        double min_pt = 0;
+        double max_pt = 0;
+        double max_abseta = 0;
+        //minimum fraction of the pT of the particle's jet
+        double min_ptfrac = 0;
+
+        bool has_cuts() const noexcept {
+            return min_pt > 0 || max_pt > 0 || max_abseta > 0 || min_ptfrac > 0;
+        }
 
+        //jetpt = 0 disables the pT fraction cut
+        bool accepts(const simon::particle& part, const double jetpt) const noexcept {
+            if(part.pt < min_pt) return false;
+            if(max_pt > 0 && part.pt > max_pt) return false;
+            if(max_abseta > 0 && std::abs(part.eta) > max_abseta) return false;
+            if(part.pt < min_ptfrac * jetpt) return false;
+            return true;
+        }
+    };
+
+    /*
+     * Flat dispatch table of MatchParams indexed by reco flavor
+     *
+     * Every flavor must be explicitly configured, either with 
+     * a set of MatchParams or as "do not match" (dr_mode = "DoNotMatch"),
+     * before the table is used. validate() checks this,
+     * so that get_params() is a single indexed load that cannot throw.
+     * A nullptr return value means reco particles of that flavor 
+     * are never matched.
+     *
+     * The MatchParams are taken from the MatchParamsRegistry, so 
+     * identical configurations share one immutable copy.
+     *
+     * Each flavor also has an Acceptance, which is kept here rather 
+     * than in the MatchParams so that gen particles of a "do not match"
+     * flavor can be cut as well. By default there are no cuts.
+     */
     class PerFlavorMatchParams {
     public:
         PerFlavorMatchParams();
@@ -58,7 +109,8 @@ namespace matching{
             MU=1,
             HADCH=2,
             PHO=3,
-            HAD0=4
+            HAD0=4,
+            NFLAVORS=5
         };
         void setup_params(
                 Flavor flavor,
@@ -80,6 +132,16 @@ namespace matching{
                 const std::string& charge_filter_mode,
                 //flavor_filter params
                 const std::string& flavor_filter_mode);
+
+        //dr_mode = "DoNotMatch" calls setup_do_not_match()
+        void setup_params(
+                Flavor flavor,
+                const MatchParamsRegistry::config& config);
+
+        void setup_do_not_match(Flavor flavor);
+
+        //can be called before or after setup_params()
+        void set_acceptance(Flavor flavor, const Acceptance& acceptance);
     
 #ifdef CMSSW_GIT_HASH
         void setup_params(
@@ -87,20 +149,60 @@ namespace matching{
                 const edm::ParameterSet& params);
 #endif
 
-        const MatchParams& get_params(Flavor flavor) const;
-        const MatchParams& get_params(const simon::particle& recopart) const;
+        //throws if any flavor has not been configured
+        void validate() const;
+
+        static Flavor get_flavor(const simon::particle& part) noexcept {
+            if(part.pdgid == 11){
+                return ELE;
+            } else if(part.pdgid == 13){
+                return MU;
+            } else if(part.pdgid == 22){
+                return PHO;
+            } else if(part.charge != 0){
+                return HADCH;
+            } else {
+                return HAD0;
+            }
+        }
+
+        const MatchParams* get_params(Flavor flavor) const noexcept {
+            return table[flavor].get();
+        }
+        const MatchParams* get_params(const simon::particle& recopart) const noexcept {
+            return table[get_flavor(recopart)].get();
+        }
+
+        //the configuration the flavor was set up with
+        //(dr_mode = "DoNotMatch" for "do not match" flavors)
+        const MatchParamsRegistry::config& get_config(Flavor flavor) const noexcept {
+            return configs[flavor];
+        }
+
+        const Acceptance& get_acceptance(Flavor flavor) const noexcept {
+            return acceptance[flavor];
+        }
+
+        bool has_acceptance_cuts() const noexcept {
+            return any_acceptance_cuts;
+        }
+
+        //cuts on the particle's own flavor
+        bool accepts(const simon::particle& part, const double jetpt) const noexcept {
+            return acceptance[get_flavor(part)].accepts(part, jetpt);
+        }
 
         void print_status() const;
 
     private:
-        MatchParamsPtr ele_params;
-        MatchParamsPtr mu_params;
-        MatchParamsPtr hadch_params;
-        MatchParamsPtr pho_params;
-        MatchParamsPtr had0_params;
-
-        MatchParamsPtr& get_target(Flavor flavor);
-        const MatchParamsPtr& get_target(Flavor flavor) const;
+        std::array<MatchParamsPtr, NFLAVORS> table;
+        std::array<bool, NFLAVORS> configured;
+        std::array<MatchParamsRegistry::config, NFLAVORS> configs;
+
+        std::array<Acceptance, NFLAVORS> acceptance;
+        bool any_acceptance_cuts;
+
+        void check_flavor(Flavor flavor) const;
     };
 };
 
@@ -0,0 +1,174 @@
+#include "ToyCandidateSet.h"
+#include "Tracing.h"
+#include "MatchHelpers.h"
+#include "SRothman/SimonTools/src/deltaR.h"
+
+#include <stdexcept>
+
+matching::ToyCandidateSet::ToyCandidateSet() :
+    genparts(nullptr),
+    params(nullptr),
+    max_chisq(0),
+    gen_order(),
+    gen_rank(),
+    nominal(),
+    envelope_dR(),
+    cand_start(1, 0),
+    candidates(),
+    nfallbacks(0) {}
+
+void matching::ToyCandidateSet::build(
+        const std::vector<simon::particle>& recoparts,
+        const std::vector<simon::particle>& genparts,
+        const PerFlavorMatchParams& params,
+        const double max_chisq,
+        const double envelope,
+        const double gen_jetpt){
+    MATCHING_TRACE_SCOPE("toy candidate search");
+
+    if(!(envelope >= 1)){
+        throw std::invalid_argument("Toy dR envelope must be >= 1");
+    }
+
+    this->genparts = &genparts;
+    this->params = &params;
+    this->max_chisq = max_chisq;
+    nfallbacks = 0;
+
+    detail::get_ptorder(genparts, gen_order);
+    detail::apply_acceptance(genparts, params, gen_jetpt, gen_order);
+    gen_rank.assign(genparts.size(), gen_order.size());
+    for(size_t k=0; k<gen_order.size(); ++k){
+        gen_rank[gen_order[k]] = k;
+    }
+
+    nominal = recoparts;
+    envelope_dR.assign(recoparts.size(), 0);
+    cand_start.assign(recoparts.size()+1, 0);
+    candidates.clear();
+
+    for(size_t iReco=0; iReco<recoparts.size(); ++iReco){
+        const auto& reco = recoparts[iReco];
+        const auto* theparms = params.get_params(reco);
+        if(theparms){
+            envelope_dR[iReco] = envelope * theparms->dR_limiter->evaluate(
+                    reco.pt, reco.eta, reco.phi);
+            //padded so that rounding cannot lose a candidate
+            //right at the edge of the envelope
+            const double radius = envelope_dR[iReco] * (1 + 1e-9) + 1e-12;
+            for(size_t iGen : gen_order){
+                const auto& gen = genparts[iGen];
+                if(simon::deltaR(gen.eta, gen.phi, reco.eta, reco.phi) > radius) continue;
+                if(!theparms->flavor_filter->evaluate(gen.charge, gen.pdgid)) continue;
+                candidates.push_back(iGen);
+            }
+        }
+        cand_start[iReco+1] = candidates.size();
+    }
+}
+
+void matching::ToyCandidateSet::match(
+        const std::vector<simon::particle>& replica,
+        const double reco_jetpt,
+        matchvec& matches,
+        matchinfovec* infos){
+    MATCHING_TRACE_SCOPE("toy matching");
+
+    matches.clear();
+    if(infos){
+        infos->clear();
+    }
+
+    if(replica.size() != nominal.size()){
+        throw std::invalid_argument("Toy replica has a different number of particles");
+    }
+
+    const auto& gens = *genparts;
+    const bool cuts = params->has_acceptance_cuts();
+    const size_t nGen = gen_order.size();
+
+    //admissible pairs of this replica
+    edges.clear();
+    edge_gen.clear();
+    reco_dRlim.assign(replica.size(), 0);
+    for(size_t iReco=0; iReco<replica.size(); ++iReco){
+        const auto& reco = replica[iReco];
+        const auto* theparms = params->get_params(nominal[iReco]);
+        if(!theparms) continue;
+        if(cuts && !params->accepts(reco, reco_jetpt)) continue;
+
+        const double dRlim = theparms->dR_limiter->evaluate(
+                reco.pt, reco.eta, reco.phi);
+        reco_dRlim[iReco] = dRlim;
+
+        const auto& nom = nominal[iReco];
+        const double shift = simon::deltaR(reco.eta, reco.phi, nom.eta, nom.phi);
+
+        auto add_edge = [&](const size_t iGen, const bool check_flavor){
+            double dR, chisq;
+            if(!detail::evaluate_pair(reco, gens[iGen], *theparms, dRlim,
+                                      dR, chisq, check_flavor)) return;
+            if(!(chisq < max_chisq)) return;
+            edges.push_back({iReco, chisq, dR});
+            edge_gen.push_back(gen_rank[iGen]);
+        };
+
+        if(shift + dRlim <= envelope_dR[iReco]){
+            for(size_t k=cand_start[iReco]; k<cand_start[iReco+1]; ++k){
+                add_edge(candidates[k], false);
+            }
+        } else {
+            ++nfallbacks;
+            for(size_t iGen : gen_order){
+                add_edge(iGen, true);
+            }
+        }
+    }
+
+    //group the pairs by gen particle, in gen pT order
+    row_start.assign(nGen+1, 0);
+    for(size_t rank : edge_gen){
+        ++row_start[rank+1];
+    }
+    for(size_t k=1; k<=nGen; ++k){
+        row_start[k] += row_start[k-1];
+    }
+    sorted_edges.resize(edges.size());
+    row_fill.assign(row_start.begin(), row_start.end()-1);
+    for(size_t e=0; e<edges.size(); ++e){
+        sorted_edges[row_fill[edge_gen[e]]++] = edges[e];
+    }
+
+    //replica pT order, for chisq ties
+    detail::get_ptorder(replica, reco_order);
+    reco_rank.resize(replica.size());
+    for(size_t r=0; r<reco_order.size(); ++r){
+        reco_rank[reco_order[r]] = r;
+    }
+
+    //greedy assignment, as in matchParticles()
+    reco_used.assign(replica.size(), false);
+    for(size_t k=0; k<nGen; ++k){
+        const edge* best = nullptr;
+        for(size_t e=row_start[k]; e<row_start[k+1]; ++e){
+            const auto& cand = sorted_edges[e];
+            if(reco_used[cand.iReco]) continue;
+            if(!best || cand.chisq < best->chisq 
+                     || (cand.chisq == best->chisq 
+                         && reco_rank[cand.iReco] < reco_rank[best->iReco])){
+                best = &cand;
+            }
+        }
+        if(best){
+            const size_t iGen = gen_order[k];
+            reco_used[best->iReco] = true;
+            matches.emplace_back(best->iReco, iGen);
+            if(infos){
+                detail::fill_info(replica[best->iReco], gens[iGen],
+                                  best->chisq, best->dR,
+                                  reco_dRlim[best->iReco],
+                                  *infos);
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef SROTHMAN_MATCHING_V2_TOYCANDIDATESET_H
+#define SROTHMAN_MATCHING_V2_TOYCANDIDATESET_H
+
+#include "SRothman/SimonTools/src/jet.h"
+#include "PerFlavorMatchParams.h"
+#include "MatchTypes.h"
+
+#include <vector>
+
+namespace matching {
+    /*
+     * Candidate pairs for toy (bootstrap) re-matching of one jet
+     *
+     * Many replicas of the reco particles, differing only in their
+     * pT, eta and phi (e.g. smeared within their resolutions), are 
+     * matched against the same gen particles. The geometric candidate
+     * search is done once, on the nominal reco particles, with the 
+     * dR limit of each reco particle widened by a factor envelope.
+     * Each replica then only re-evaluates the dR, dR limit, filters and
+     * chisq of those candidates, and redoes the greedy assignment.
+     *
+     * The result of each replica is identical to matchParticles() on
+     * the replica: if a replica particle moved so far (shift + its 
+     * replica dR limit > the widened nominal limit) that the envelope 
+     * might miss one of its candidates, that particle falls back to 
+     * a scan of all the gen particles. A larger envelope makes this
+     * rarer at the cost of more candidates per replica.
+     *
+     * The replicas must have the same particles, in the same order, 
+     * with the same charge and pdgid as the nominal reco particles.
+     * The set must not outlive the gen particles or the parameters
+     * it was built with.
+     */
+    class ToyCandidateSet {
+    public:
+        ToyCandidateSet();
+
+        //gen_jetpt is for the acceptance pT fraction cut; 0 disables it
+        void build(
+                const std::vector<simon::particle>& recoparts,
+                const std::vector<simon::particle>& genparts,
+                const PerFlavorMatchParams& params,
+                const double max_chisq,
+                const double envelope,
+                const double gen_jetpt = 0);
+
+        /*
+         * Matches one replica of the reco particles
+         * reco_jetpt is the replica jet pT for the acceptance
+         * pT fraction cut; 0 disables it
+         * The matches are in the same order as matchParticles()
+         * infos may be nullptr
+         * Not thread-safe: the scratch space is reused between replicas
+         */
+        void match(
+                const std::vector<simon::particle>& replica,
+                const double reco_jetpt,
+                matchvec& matches,
+                matchinfovec* infos = nullptr);
+
+        size_t nCandidates() const {
+            return candidates.size();
+        }
+
+        //number of replica particles that fell back to a full scan
+        size_t nFallbacks() const {
+            return nfallbacks;
+        }
+
+    private:
+        const std::vector<simon::particle>* genparts;
+        const PerFlavorMatchParams* params;
+        double max_chisq;
+
+        //accepted gen particles in decreasing pT order
+        std::vector<size_t> gen_order;
+        //position in gen_order, or gen_order.size() if not accepted
+        std::vector<size_t> gen_rank;
+
+        //per reco particle: nominal kinematics and widened dR limit
+        std::vector<simon::particle> nominal;
+        std::vector<double> envelope_dR;
+
+        //CSR, one row of gen indices per reco particle, in gen pT order
+        //flavor filter already applied
+        std::vector<size_t> cand_start;
+        std::vector<size_t> candidates;
+
+        size_t nfallbacks;
+
+        struct edge {
+            size_t iReco;
+            double chisq;
+            double dR;
+        };
+
+        //scratch space for match()
+        std::vector<edge> edges;
+        std::vector<size_t> edge_gen;
+        std::vector<edge> sorted_edges;
+        std::vector<size_t> row_start;
+        std::vector<size_t> row_fill;
+        std::vector<size_t> reco_order;
+        std::vector<size_t> reco_rank;
+        std::vector<double> reco_dRlim;
+        std::vector<bool> reco_used;
+    };
+};
+
+#endif
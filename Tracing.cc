@@ -0,0 +1,130 @@
+#include "Tracing.h"
+
+#ifdef MATCHING_ENABLE_TRACING
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    struct traceentry {
+        const char* name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    struct ringbuffer {
+        explicit ringbuffer(const unsigned tid) :
+            tid(tid),
+            entries(matching::tracing::RING_SIZE),
+            count(0) {}
+
+        const unsigned tid;
+        std::vector<traceentry> entries;
+        //total number of entries ever recorded
+        size_t count;
+    };
+
+    //buffers outlive the threads that own them,
+    //so that they can be exported after the threads have exited.
+    //The buffer of an exited thread is handed on to the next new thread,
+    //so short-lived threads do not grow the registry without bound
+    struct registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ringbuffer>> buffers;
+        std::vector<ringbuffer*> free_buffers;
+    };
+
+    registry& get_registry(){
+        static registry reg;
+        return reg;
+    }
+
+    struct bufferhandle {
+        ringbuffer* buffer = nullptr;
+
+        ~bufferhandle(){
+            if(buffer){
+                auto& reg = get_registry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                reg.free_buffers.push_back(buffer);
+            }
+        }
+    };
+
+    ringbuffer& get_thread_buffer(){
+        thread_local bufferhandle handle;
+        if(!handle.buffer){
+            auto& reg = get_registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if(!reg.free_buffers.empty()){
+                handle.buffer = reg.free_buffers.back();
+                reg.free_buffers.pop_back();
+            } else {
+                reg.buffers.push_back(
+                        std::make_unique<ringbuffer>(reg.buffers.size()));
+                handle.buffer = reg.buffers.back().get();
+            }
+        }
+        return *handle.buffer;
+    }
+
+    const auto epoch = std::chrono::steady_clock::now();
+};
+
+uint64_t matching::tracing::now_ns(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+}
+
+void matching::tracing::record(
+        const char* name,
+        const uint64_t start_ns,
+        const uint64_t end_ns){
+    auto& buffer = get_thread_buffer();
+    buffer.entries[buffer.count % RING_SIZE] = {name, start_ns, end_ns};
+    ++buffer.count;
+}
+
+void matching::tracing::clear(){
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for(auto& buffer : reg.buffers){
+        buffer->count = 0;
+    }
+}
+
+void matching::tracing::write_chrome_trace(const std::string& path){
+    FILE* file = std::fopen(path.c_str(), "w");
+    if(!file){
+        throw std::runtime_error("write_chrome_trace: cannot open " + path);
+    }
+
+    auto& reg = get_registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for(const auto& buffer : reg.buffers){
+        size_t begin = buffer->count > RING_SIZE ? buffer->count - RING_SIZE : 0;
+        for(size_t i=begin; i<buffer->count; ++i){
+            const auto& entry = buffer->entries[i % RING_SIZE];
+            //timestamps are in microseconds
+            std::fprintf(file,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n",
+                    entry.name,
+                    buffer->tid,
+                    entry.start_ns * 1e-3,
+                    (entry.end_ns - entry.start_ns) * 1e-3);
+            first = false;
+        }
+    }
+    std::fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    std::fclose(file);
+}
+
+#endif
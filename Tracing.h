@@ -0,0 +1,81 @@
+#ifndef SROTHMAN_MATCHING_V2_TRACING_H
+#define SROTHMAN_MATCHING_V2_TRACING_H
+
+#include <string>
+
+/*
+ * Lightweight scoped timers for the phases of the matching
+ *
+ * Only active when compiled with -DMATCHING_ENABLE_TRACING.
+ * Otherwise MATCHING_TRACE_SCOPE() expands to nothing and
+ * write_chrome_trace() is a no-op, so there is no runtime cost.
+ *
+ * Each thread records into its own fixed-size ring buffer
+ * (the oldest entries are overwritten once it is full),
+ * so recording never takes a lock. write_chrome_trace() dumps
+ * all buffers in the Chrome trace event JSON format, which can
+ * be loaded in chrome://tracing or ui.perfetto.dev. It should
+ * only be called while no matching is running.
+ *
+ * The name passed to MATCHING_TRACE_SCOPE() must be a string literal
+ */
+
+#ifdef MATCHING_ENABLE_TRACING
+
+#include <chrono>
+#include <cstdint>
+
+namespace matching {
+    namespace tracing {
+        static constexpr size_t RING_SIZE = 1 << 16;
+
+        uint64_t now_ns();
+
+        void record(const char* name,
+                    const uint64_t start_ns,
+                    const uint64_t end_ns);
+
+        void write_chrome_trace(const std::string& path);
+
+        //discard everything recorded so far
+        void clear();
+
+        class ScopedTimer {
+        public:
+            explicit ScopedTimer(const char* name) :
+                name(name),
+                start_ns(now_ns()) {}
+
+            ~ScopedTimer() {
+                record(name, start_ns, now_ns());
+            }
+
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        private:
+            const char* name;
+            const uint64_t start_ns;
+        };
+    };
+};
+
+#define MATCHING_TRACE_CONCAT_IMPL(a, b) a##b
+#define MATCHING_TRACE_CONCAT(a, b) MATCHING_TRACE_CONCAT_IMPL(a, b)
+#define MATCHING_TRACE_SCOPE(name) \
+    matching::tracing::ScopedTimer MATCHING_TRACE_CONCAT(trace_timer_, __LINE__)(name)
+
+#else
+
+namespace matching {
+    namespace tracing {
+        inline void write_chrome_trace([[maybe_unused]] const std::string& path) {}
+        inline void clear() {}
+    };
+};
+
+#define MATCHING_TRACE_SCOPE(name)
+
+#endif
+
+#endif
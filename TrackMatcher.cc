@@ -1,6 +1,13 @@
 #include "TrackMatcher.h"
+#include "Tracing.h"
+#include "MatchHelpers.h"
 #include "SRothman/SimonTools/src/deltaR.h"
-#include <numeric>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
 
 static constexpr double INF = std::numeric_limits<double>::infinity();
 
@@ -57,10 +64,50 @@ matching::TrackMatcher::TrackMatcher(
         const double hadch_opp_charge_penalty,
         const double hadch_no_charge_penalty,
         const std::string& hadch_charge_filter_mode,
-        const std::string& hadch_flavor_filter_mode):
+        const std::string& hadch_flavor_filter_mode,
+
+        //photon params
+        const std::string& pho_dr_mode,
+        const double pho_dr_param1,
+        const double pho_dr_param2,
+        const double pho_dr_param3,
+        const std::string& pho_ptres_mode,
+        const double pho_ptres_param1,
+        const double pho_ptres_param2,
+        const std::string& pho_angres_mode,
+        const double pho_angres_param1,
+        const double pho_angres_param2,
+        const double pho_opp_charge_penalty,
+        const double pho_no_charge_penalty,
+        const std::string& pho_charge_filter_mode,
+        const std::string& pho_flavor_filter_mode,
+
+        //neutral hadron params
+        const std::string& had0_dr_mode,
+        const double had0_dr_param1,
+        const double had0_dr_param2,
+        const double had0_dr_param3,
+        const std::string& had0_ptres_mode,
+        const double had0_ptres_param1,
+        const double had0_ptres_param2,
+        const std::string& had0_angres_mode,
+        const double had0_angres_param1,
+        const double had0_angres_param2,
+        const double had0_opp_charge_penalty,
+        const double had0_no_charge_penalty,
+        const std::string& had0_charge_filter_mode,
+        const std::string& had0_flavor_filter_mode):
 
     jet_dR_threshold(jet_dR_threshold),
     max_chisq(max_chisq),
+    parallel_threshold(0),
+    parallel_nthreads(1),
+    max_candidates_per_gen(0),
+    max_pair_evaluations(0),
+    auto_strategy(false),
+    cost_model(),
+    toy_envelope(DEFAULT_TOY_ENVELOPE),
+    recorder(nullptr),
     particle_params() {
     
     particle_params.setup_params(
@@ -113,105 +160,463 @@ matching::TrackMatcher::TrackMatcher(
         hadch_no_charge_penalty,
         hadch_charge_filter_mode,
         hadch_flavor_filter_mode);
+
+    particle_params.setup_params(
+        PerFlavorMatchParams::PHO,
+        pho_dr_mode,
+        pho_dr_param1,
+        pho_dr_param2,
+        pho_dr_param3,
+        pho_ptres_mode,
+        pho_ptres_param1,
+        pho_ptres_param2,
+        pho_angres_mode,
+        pho_angres_param1,
+        pho_angres_param2,
+        pho_opp_charge_penalty,
+        pho_no_charge_penalty,
+        pho_charge_filter_mode,
+        pho_flavor_filter_mode);
+
+    particle_params.setup_params(
+        PerFlavorMatchParams::HAD0,
+        had0_dr_mode,
+        had0_dr_param1,
+        had0_dr_param2,
+        had0_dr_param3,
+        had0_ptres_mode,
+        had0_ptres_param1,
+        had0_ptres_param2,
+        had0_angres_mode,
+        had0_angres_param1,
+        had0_angres_param2,
+        had0_opp_charge_penalty,
+        had0_no_charge_penalty,
+        had0_charge_filter_mode,
+        had0_flavor_filter_mode);
+
+    particle_params.validate();
 }
 
+/*
+ * The free reco candidates are kept in one contiguous array together 
+ * with everything the pair evaluation needs, and a matched candidate 
+ * is swap-removed, so each gen particle only visits free candidates.
+ * Swap-removal loses the pT order of the array, so chisq ties are
+ * broken explicitly by pT rank, as in the pT-ordered scan
+ */
 template <typename T>
-static void match_one_to_one(
+static void match_one_to_one_sequential(
         const std::vector<T>& recovec,
         const std::vector<T>& genvec,
-        const matching::PerFlavorMatchParams& particle_params,
+        const std::vector<size_t>& reco_ptorder,
+        const std::vector<size_t>& gen_ptorder,
+        const matching::detail::reco_index& index,
+        const uint8_t* gen_classes,
         const double max_chisq,
-        matching::matchvec& matches){
-
-    matches.clear();
-
-    std::vector<size_t> gen_ptorder(genvec.size());
-    std::iota(gen_ptorder.begin(), gen_ptorder.end(), 0);
-    std::sort(gen_ptorder.begin(), gen_ptorder.end(),
-            [&](size_t i1, size_t i2){
-                return genvec[i1].pt > genvec[i2].pt;
-            });
+        matching::matchvec& matches,
+        matching::matchinfovec* infos){
+    MATCHING_TRACE_SCOPE("candidate evaluation + assignment");
 
-    std::vector<size_t> reco_ptorder(recovec.size());
-    std::iota(reco_ptorder.begin(), reco_ptorder.end(), 0);
-    std::sort(reco_ptorder.begin(), reco_ptorder.end(),
-            [&](size_t i1, size_t i2){
-                return recovec[i1].pt > recovec[i2].pt;
-            });
+    struct candidate {
+        T reco;
+        const matching::MatchParams* params;
+        double dRlim;
+        size_t iReco;
+        size_t rank;
+        uint8_t flavor;
+    };
 
-    std::vector<bool> reco_used(recovec.size(), false);
+    std::vector<candidate> free_recos;
+    free_recos.reserve(reco_ptorder.size());
+    for(size_t rank=0; rank<reco_ptorder.size(); ++rank){
+        const size_t iReco = reco_ptorder[rank];
+        free_recos.push_back({recovec[iReco], 
+                              index.params[iReco],
+                              index.dRlim[iReco],
+                              iReco, rank,
+                              index.flavor[iReco]});
+    }
 
     for(size_t iGen : gen_ptorder){
+        if(free_recos.empty()) break;
+
         const auto& gen = genvec[iGen];
+        const unsigned gen_class = gen_classes ? gen_classes[iGen] : 0;
         
         double best_chisq = INF;
-        int best_ireco = -1;
+        double best_dR = INF;
+        int best_k = -1;
+
+        for(size_t k=0; k<free_recos.size(); ++k){
+            const auto& cand = free_recos[k];
+
+            //flavor filter, precomputed in the GenIndex
+            if(gen_classes && !(gen_class & (1u << cand.flavor))) continue;
+
+            double dR, chisq;
+            if(!matching::detail::evaluate_pair(cand.reco, gen,
+                                                *cand.params,
+                                                cand.dRlim,
+                                                dR, chisq,
+                                                gen_classes == nullptr)) continue;
+
+            if(chisq < best_chisq || (best_k >= 0 && chisq == best_chisq
+                                      && cand.rank < free_recos[best_k].rank)){
+                best_chisq = chisq;
+                best_dR = dR;
+                best_k = k;
+            }
+        }//end reco loop
+        if(best_k>=0 && best_chisq < max_chisq){
+            const auto& best = free_recos[best_k];
+            matches.emplace_back(best.iReco, iGen);
+            if(infos){
+                matching::detail::fill_info(
+                        best.reco, gen,
+                        best_chisq, best_dR,
+                        best.dRlim,
+                        *infos);
+            }
+            free_recos[best_k] = free_recos.back();
+            free_recos.pop_back();
+        }
+    }//end gen loop
+}//end match_one_to_one_sequential()
+
+/*
+ * Small-jet version of match_one_to_one_sequential(), for jets with
+ * at most TrackMatcher::SMALL_JET_CAPACITY reco and gen particles. 
+ * Everything lives on the stack: the pT orders come from a sorting
+ * network, the active reco particles are compacted in pT order 
+ * together with their parameters, and reco_used is a bitmask, 
+ * so only the free candidates are visited.
+ * The result is identical to the general path
+ */
+template <typename T>
+static void match_one_to_one_small(
+        const std::vector<T>& recovec,
+        const std::vector<T>& genvec,
+        const double reco_jetpt,
+        const double gen_jetpt,
+        const std::vector<size_t>* gen_ptorder,
+        const uint8_t* gen_classes,
+        const matching::PerFlavorMatchParams& particle_params,
+        const double max_chisq,
+        matching::matchvec& matches,
+        matching::matchinfovec* infos){
+    MATCHING_TRACE_SCOPE("small jet matching");
 
-        for(size_t iReco : reco_ptorder){
-            if(reco_used[iReco]) continue;
+    constexpr size_t N = matching::TrackMatcher::SMALL_JET_CAPACITY;
+    static_assert(N <= 64, "reco_used mask is 64 bits");
 
-            const auto& reco = recovec[iReco];
+    const bool cuts = particle_params.has_acceptance_cuts();
 
-            const auto& theparms = particle_params.get_params(reco);
+    size_t reco_order[N];
+    matching::detail::get_ptorder_network<N>(recovec, reco_order);
 
-            double dR = simon::deltaR(gen.eta, gen.phi,
-                                     reco.eta, reco.phi);
+    size_t iRecos[N];
+    const matching::MatchParams* params[N];
+    double dRlims[N];
+    uint8_t flavors[N];
+    size_t nActive = 0;
+    for(size_t r=0; r<recovec.size(); ++r){
+        const size_t iReco = reco_order[r];
+        const auto& reco = recovec[iReco];
+        const auto flavor = matching::PerFlavorMatchParams::get_flavor(reco);
+        const auto* theparms = particle_params.get_params(flavor);
+        if(!theparms) continue;
+        if(cuts && !particle_params.accepts(reco, reco_jetpt)) continue;
 
-            double dRlim = theparms.dR_limiter->evaluate(
-                    reco.pt, reco.eta, reco.phi);
-            if(dR > dRlim) continue;
+        iRecos[nActive] = iReco;
+        params[nActive] = theparms;
+        dRlims[nActive] = theparms->dR_limiter->evaluate(
+                reco.pt, reco.eta, reco.phi);
+        flavors[nActive] = flavor;
+        ++nActive;
+    }
+
+    size_t gen_order[N];
+    size_t nGen = 0;
+    if(gen_ptorder){
+        nGen = gen_ptorder->size();
+        std::copy(gen_ptorder->begin(), gen_ptorder->end(), gen_order);
+    } else {
+        size_t own_order[N];
+        matching::detail::get_ptorder_network<N>(genvec, own_order);
+        for(size_t g=0; g<genvec.size(); ++g){
+            if(cuts && !particle_params.accepts(genvec[own_order[g]], gen_jetpt)) continue;
+            gen_order[nGen++] = own_order[g];
+        }
+    }
+
+    //bit a set = active reco particle a is still free
+    uint64_t reco_free = nActive == 64 ? ~uint64_t(0) 
+                                       : (uint64_t(1) << nActive) - 1;
+
+    for(size_t g=0; g<nGen && reco_free; ++g){
+        const size_t iGen = gen_order[g];
+        const auto& gen = genvec[iGen];
+        const unsigned gen_class = gen_classes ? gen_classes[iGen] : 0;
+
+        double best_chisq = INF;
+        double best_dR = INF;
+        int best_a = -1;
 
-            if(!theparms.charge_filter->evaluate(
-                    reco.charge, gen.charge)) continue;
+        for(uint64_t remaining = reco_free; remaining; remaining &= remaining-1){
+            const int a = __builtin_ctzll(remaining);
 
-            if(!theparms.flavor_filter->evaluate(
-                    gen.charge,
-                    gen.pdgid)) continue;
+            if(gen_classes && !(gen_class & (1u << flavors[a]))) continue;
 
-            double chisq = theparms.chi_sq_fn.evaluate(
-                    reco.pt, reco.eta, 
-                    reco.phi, reco.charge,
-                    gen.pt, gen.eta, 
-                    gen.phi, gen.charge);
+            double dR, chisq;
+            if(!matching::detail::evaluate_pair(recovec[iRecos[a]], gen,
+                                                *params[a], dRlims[a],
+                                                dR, chisq,
+                                                gen_classes == nullptr)) continue;
 
             if(chisq < best_chisq){
                 best_chisq = chisq;
-                best_ireco = iReco;
+                best_dR = dR;
+                best_a = a;
             }
-        }//end gen loop
-        if(best_ireco>=0 && best_chisq < max_chisq){
-            reco_used[best_ireco] = true;
-            matches.emplace_back(best_ireco, iGen);
         }
-    }//end reco loop
+        if(best_a>=0 && best_chisq < max_chisq){
+            reco_free &= ~(uint64_t(1) << best_a);
+            matches.emplace_back(iRecos[best_a], iGen);
+            if(infos){
+                matching::detail::fill_info(
+                        recovec[iRecos[best_a]], gen,
+                        best_chisq, best_dR,
+                        dRlims[best_a],
+                        *infos);
+            }
+        }
+    }
+}//end match_one_to_one_small()
+
+/*
+ * Large jets go through the CandidateGraph, so that the expensive 
+ * pair evaluation can be split across threads
+ * Small jets use the fused sequential loop, which avoids 
+ * building the graph, and jets within SMALL_JET_CAPACITY
+ * use its allocation-free version. All the paths give identical results
+ * The choice is made either with parallel_threshold, or,
+ * if cost_model is not nullptr, from the cost model
+ * The candidate limits are only implemented in the CandidateGraph,
+ * so they always take that path
+ * The precomputed gen pT order and flavor classes (from a GenIndex, 
+ * may be nullptr) are only used by the sequential loop
+ * The jet pTs are for the acceptance pT fraction cut (0 = disabled)
+ * The matches (and infos) are appended to the output vectors
+ */
+static void match_one_to_one(
+        const std::vector<simon::particle>& recovec,
+        const std::vector<simon::particle>& genvec,
+        const double reco_jetpt,
+        const double gen_jetpt,
+        const std::vector<size_t>* gen_ptorder,
+        const uint8_t* gen_classes,
+        const matching::PerFlavorMatchParams& particle_params,
+        const double max_chisq,
+        const size_t parallel_threshold,
+        const unsigned parallel_nthreads,
+        const size_t max_candidates,
+        const size_t max_pairs,
+        const matching::MatchCostModel* cost_model,
+        matching::matchvec& matches,
+        matching::matchinfovec* infos,
+        matching::truncationinfo* truncation){
+
+    if(truncation){
+        *truncation = matching::truncationinfo();
+    }
+
+    unsigned nthreads = parallel_nthreads;
+    if(nthreads == 0){
+        nthreads = std::thread::hardware_concurrency();
+    }
+
+    auto match_graph = [&](const matching::CandidateGraph::Strategy strategy,
+                           const unsigned graph_nthreads){
+        matching::CandidateGraph graph;
+        graph.build(recovec, genvec,
+                    particle_params, max_chisq,
+                    strategy, graph_nthreads,
+                    max_candidates, max_pairs,
+                    reco_jetpt, gen_jetpt);
+        if(matches.empty() && (!infos || infos->empty())){
+            matching::assign_greedy(graph, matches, infos);
+        } else {
+            matching::matchvec graphmatches;
+            matching::matchinfovec graphinfos;
+            matching::assign_greedy(graph, graphmatches, 
+                                    infos ? &graphinfos : nullptr);
+            matches.insert(matches.end(), 
+                           graphmatches.begin(), graphmatches.end());
+            if(infos){
+                infos->insert(infos->end(), 
+                              graphinfos.begin(), graphinfos.end());
+            }
+        }
+        if(truncation){
+            *truncation = graph.get_truncation();
+        }
+    };
+
+    const bool limited = max_candidates > 0 || max_pairs > 0;
+    if(!limited 
+            && recovec.size() <= matching::TrackMatcher::SMALL_JET_CAPACITY
+            && genvec.size() <= matching::TrackMatcher::SMALL_JET_CAPACITY){
+        match_one_to_one_small(
+                recovec, genvec,
+                reco_jetpt, gen_jetpt,
+                gen_ptorder, gen_classes,
+                particle_params, max_chisq,
+                matches, infos);
+        return;
+    }
+
+    const size_t npairs = recovec.size() * genvec.size();
+    const bool parallel = parallel_threshold > 0 && npairs >= parallel_threshold 
+                       && nthreads > 1 && genvec.size() > 1;
+
+    //limited jets never consult the cost model: they always use 
+    //the brute force graph, whose result does not depend on nthreads
+    if(limited){
+        match_graph(matching::CandidateGraph::BRUTEFORCE,
+                    parallel ? nthreads : 1);
+        return;
+    }
+
+    if(!cost_model && parallel){
+        match_graph(matching::CandidateGraph::BRUTEFORCE, nthreads);
+        return;
+    }
+
+    if(cost_model){
+        size_t nActive;
+        double max_dRlim;
+        matching::detail::get_reco_extent(
+                recovec, particle_params, reco_jetpt,
+                nActive, max_dRlim);
+
+        const auto strategy = cost_model->choose(
+                nActive, genvec.size(),
+                max_dRlim, matching::MatchCostModel::get_area(genvec),
+                nthreads);
+        if(strategy == matching::MatchCostModel::GRID){
+            match_graph(matching::CandidateGraph::GRID, 1);
+            return;
+        } else if(strategy == matching::MatchCostModel::PARALLEL){
+            match_graph(matching::CandidateGraph::BRUTEFORCE, nthreads);
+            return;
+        }
+    }
+
+    //the reco index is only needed by the sequential loop;
+    //the graph builds its own
+    std::vector<size_t> reco_ptorder;
+    matching::detail::get_ptorder(recovec, reco_ptorder);
+
+    matching::detail::reco_index index;
+    matching::detail::build_reco_index(
+            recovec, particle_params, reco_jetpt,
+            reco_ptorder, index);
+
+    std::vector<size_t> own_gen_ptorder;
+    if(!gen_ptorder){
+        matching::detail::get_ptorder(genvec, own_gen_ptorder);
+        matching::detail::apply_acceptance(
+                genvec, particle_params, gen_jetpt, 
+                own_gen_ptorder);
+        gen_ptorder = &own_gen_ptorder;
+    }
+
+    match_one_to_one_sequential(
+            recovec, genvec,
+            reco_ptorder, *gen_ptorder,
+            index,
+            gen_classes,
+            max_chisq,
+            matches,
+            infos);
 }//end match_one_to_one()
 
 void matching::TrackMatcher::matchJets(
         const std::vector<simon::jet>& recojets,
         const std::vector<simon::jet>& genjets,
-        matchvec& matches){
+        matchvec& matches) const {
+    match_jets(recojets, genjets, nullptr, matches, nullptr);
+}
+
+void matching::TrackMatcher::matchJets(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        matchvec& matches,
+        matchinfovec& infos) const {
+    match_jets(recojets, genjets, nullptr, matches, &infos);
+}
+
+void matching::TrackMatcher::buildGenIndex(
+        const std::vector<simon::jet>& genjets,
+        GenIndex& genindex) const {
+    genindex.build(genjets, particle_params);
+}
+
+void matching::TrackMatcher::check_index(const GenIndex& genindex) const {
+    if(!genindex.built_with(particle_params)){
+        throw std::invalid_argument("GenIndex was not built by this TrackMatcher");
+    }
+}
+
+void matching::TrackMatcher::matchJets(
+        const std::vector<simon::jet>& recojets,
+        const GenIndex& genindex,
+        matchvec& matches) const {
+    check_index(genindex);
+    match_jets(recojets, genindex.get_jets(), &genindex.jet_ptorder(),
+               matches, nullptr);
+}
+
+void matching::TrackMatcher::matchJets(
+        const std::vector<simon::jet>& recojets,
+        const GenIndex& genindex,
+        matchvec& matches,
+        matchinfovec& infos) const {
+    check_index(genindex);
+    match_jets(recojets, genindex.get_jets(), &genindex.jet_ptorder(),
+               matches, &infos);
+}
+
+void matching::TrackMatcher::match_jets(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        const std::vector<size_t>* gen_ptorder,
+        matchvec& matches,
+        matchinfovec* infos,
+        const bool record) const {
+    MATCHING_TRACE_SCOPE("matchJets");
+
     matches.clear();
+    if(infos){
+        infos->clear();
+    }
 
-    std::vector<size_t> gen_ptorder(genjets.size());
-    std::iota(gen_ptorder.begin(), gen_ptorder.end(), 0);
-    std::sort(gen_ptorder.begin(), gen_ptorder.end(),
-            [&](size_t i1, size_t i2){
-                return genjets[i1].pt > genjets[i2].pt;
-            });
+    std::vector<size_t> own_gen_ptorder;
+    if(!gen_ptorder){
+        detail::get_ptorder(genjets, own_gen_ptorder);
+        gen_ptorder = &own_gen_ptorder;
+    }
 
-    std::vector<size_t> reco_ptorder(recojets.size());
-    std::iota(reco_ptorder.begin(), reco_ptorder.end(), 0);
-    std::sort(reco_ptorder.begin(), reco_ptorder.end(),
-            [&](size_t i1, size_t i2){
-                return recojets[i1].pt > recojets[i2].pt;
-            });
+    std::vector<size_t> reco_ptorder;
+    detail::get_ptorder(recojets, reco_ptorder);
 
     std::vector<bool> gen_used(genjets.size(), false);
     for(const size_t iRecoJet : reco_ptorder){
         double best_dR = INF;
         int matched_gen = -1;
         const auto& recojet = recojets[iRecoJet];
-        for(const size_t iGenJet : gen_ptorder){
+        for(const size_t iGenJet : *gen_ptorder){
             if(gen_used[iGenJet]) continue;
 
             const auto& genjet = genjets[iGenJet];
@@ -227,39 +632,811 @@ void matching::TrackMatcher::matchJets(
         if(best_dR < jet_dR_threshold){
             matches.emplace_back(iRecoJet, matched_gen);
             gen_used[matched_gen] = true;
+            if(infos){
+                infos->emplace_back(
+                        std::numeric_limits<float>::quiet_NaN(),
+                        best_dR, jet_dR_threshold,
+                        recojet.pt - genjets[matched_gen].pt,
+                        matchinfo::NOFLAVOR);
+            }
         }
     }
+
+    if(recorder && record){
+        recorder->write_event(recojets, genjets, matches);
+    }
+}
+
+void matching::TrackMatcher::matchParticles(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        Eigen::MatrixXd& tmat) const {
+    matchvec matches;
+    match_particles(recojet, genjet, nullptr, nullptr,
+                    tmat, matches, nullptr, nullptr);
+}
+
+void matching::TrackMatcher::matchParticles(
+        const simon::jet& recojet,
+        const GenIndex& genindex,
+        const size_t iGenJet,
+        Eigen::MatrixXd& tmat) const {
+    check_index(genindex);
+    matchvec matches;
+    match_particles(recojet, genindex.get_jets()[iGenJet],
+                    &genindex.particle_ptorder(iGenJet),
+                    genindex.flavor_classes(iGenJet),
+                    tmat, matches, nullptr, nullptr);
+}
+
+void matching::TrackMatcher::matchParticles(
+        const simon::jet& recojet,
+        const GenIndex& genindex,
+        const size_t iGenJet,
+        Eigen::MatrixXd& tmat,
+        matchvec& matches,
+        matchinfovec& infos) const {
+    check_index(genindex);
+    match_particles(recojet, genindex.get_jets()[iGenJet],
+                    &genindex.particle_ptorder(iGenJet),
+                    genindex.flavor_classes(iGenJet),
+                    tmat, matches, &infos, nullptr);
+}
+
+void matching::TrackMatcher::matchParticles(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        Eigen::MatrixXd& tmat,
+        matchvec& matches,
+        matchinfovec& infos) const {
+    match_particles(recojet, genjet, nullptr, nullptr,
+                    tmat, matches, &infos, nullptr);
+}
+
+void matching::TrackMatcher::matchParticles(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        Eigen::MatrixXd& tmat,
+        matchvec& matches,
+        matchinfovec& infos,
+        truncationinfo& truncation) const {
+    match_particles(recojet, genjet, nullptr, nullptr,
+                    tmat, matches, &infos, &truncation);
 }
 
 void matching::TrackMatcher::matchParticles(
         const simon::jet& recojet,
         const simon::jet& genjet,
-        Eigen::MatrixXd& tmat){
+        MatchAccumulator& accumulator) const {
+    MATCHING_TRACE_SCOPE("matchParticles");
+
+    matchvec matches;
+    matchinfovec infos;
+    match_one_to_one(
+            recojet.particles, genjet.particles,
+            recojet.pt, genjet.pt,
+            nullptr, nullptr,
+            particle_params,
+            max_chisq,
+            parallel_threshold,
+            parallel_nthreads,
+            max_candidates_per_gen,
+            max_pair_evaluations,
+            auto_strategy ? &cost_model : nullptr,
+            matches,
+            &infos,
+            nullptr);
+
+    MATCHING_TRACE_SCOPE("accumulate");
+    accumulator.accumulate(recojet, genjet, matches, infos);
+}
+
+void matching::TrackMatcher::match_particles(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const std::vector<size_t>* gen_ptorder,
+        const uint8_t* gen_classes,
+        Eigen::MatrixXd& tmat,
+        matchvec& matches,
+        matchinfovec* infos,
+        truncationinfo* truncation) const {
+    MATCHING_TRACE_SCOPE("matchParticles");
 
     tmat.resize(recojet.nPart, genjet.nPart);
     tmat.setZero();
 
+    matches.clear();
+    if(infos){
+        infos->clear();
+    }
+
     const auto& genparts = genjet.particles;
     const auto& recoparts = recojet.particles;
 
-    matchvec matches;
     match_one_to_one(
             recoparts, genparts,
+            recojet.pt, genjet.pt,
+            gen_ptorder, gen_classes,
             particle_params,
             max_chisq,
-            matches);
+            parallel_threshold,
+            parallel_nthreads,
+            max_candidates_per_gen,
+            max_pair_evaluations,
+            auto_strategy ? &cost_model : nullptr,
+            matches,
+            infos,
+            truncation);
 
+    MATCHING_TRACE_SCOPE("fill tmat");
     for(const auto& match : matches){
         tmat(match.iReco, match.iGen) = 1;
     }
 }
 
+void matching::TrackMatcher::matchEvent(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        eventresult& result) const {
+    match_event(recojets, genjets, nullptr, result);
+}
+
+void matching::TrackMatcher::matchEvent(
+        const std::vector<simon::jet>& recojets,
+        const GenIndex& genindex,
+        eventresult& result) const {
+    check_index(genindex);
+    match_event(recojets, genindex.get_jets(), &genindex, result);
+}
+
+void matching::TrackMatcher::match_event(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        const GenIndex* genindex,
+        eventresult& result) const {
+    MATCHING_TRACE_SCOPE("matchEvent");
+
+    result.clear();
+
+    match_jets(recojets, genjets, 
+               genindex ? &genindex->jet_ptorder() : nullptr,
+               result.jetmatches, &result.jetinfos, false);
+
+    //every jet pair has at most min(nReco, nGen) particle matches,
+    //so this is the only allocation (if any) of the particle outputs;
+    //only small jets are matched without scratch allocations
+    size_t maxmatches = 0;
+    for(const auto& jetmatch : result.jetmatches){
+        maxmatches += std::min(recojets[jetmatch.iReco].particles.size(),
+                               genjets[jetmatch.iGen].particles.size());
+    }
+    result.particlematches.reserve(maxmatches);
+    result.particleinfos.reserve(maxmatches);
+    result.offsets.reserve(result.jetmatches.size()+1);
+
+    result.offsets.push_back(0);
+    for(const auto& jetmatch : result.jetmatches){
+        const auto& recojet = recojets[jetmatch.iReco];
+        const auto& genjet = genjets[jetmatch.iGen];
+
+        MATCHING_TRACE_SCOPE("matchParticles");
+        match_one_to_one(
+                recojet.particles, genjet.particles,
+                recojet.pt, genjet.pt,
+                genindex ? &genindex->particle_ptorder(jetmatch.iGen) : nullptr,
+                genindex ? genindex->flavor_classes(jetmatch.iGen) : nullptr,
+                particle_params,
+                max_chisq,
+                parallel_threshold,
+                parallel_nthreads,
+                max_candidates_per_gen,
+                max_pair_evaluations,
+                auto_strategy ? &cost_model : nullptr,
+                result.particlematches,
+                &result.particleinfos,
+                nullptr);
+        result.offsets.push_back(result.particlematches.size());
+    }
+
+    if(recorder){
+        recorder->write_event(recojets, genjets, result);
+    }
+}
+
+//concatenate the particles of all jets
+//that are inside the acceptance
+static void flatten_particles(
+        const std::vector<simon::jet>& jets,
+        const matching::PerFlavorMatchParams& particle_params,
+        std::vector<simon::particle>& parts,
+        std::vector<size_t>& jetidxs,
+        std::vector<size_t>& partidxs){
+
+    size_t nPart = 0;
+    for(const auto& jet : jets){
+        nPart += jet.particles.size();
+    }
+    parts.clear();
+    jetidxs.clear();
+    partidxs.clear();
+    parts.reserve(nPart);
+    jetidxs.reserve(nPart);
+    partidxs.reserve(nPart);
+
+    const bool cuts = particle_params.has_acceptance_cuts();
+    for(size_t iJet=0; iJet<jets.size(); ++iJet){
+        const auto& jetparts = jets[iJet].particles;
+        for(size_t iPart=0; iPart<jetparts.size(); ++iPart){
+            if(cuts && !particle_params.accepts(jetparts[iPart], jets[iJet].pt)){
+                continue;
+            }
+            parts.push_back(jetparts[iPart]);
+            jetidxs.push_back(iJet);
+            partidxs.push_back(iPart);
+        }
+    }
+}
+
+void matching::TrackMatcher::matchEventParticles(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        eventmatchvec& matches) const {
+    match_event_particles(recojets, genjets, nullptr, matches, nullptr);
+}
+
+void matching::TrackMatcher::matchEventParticles(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        eventmatchvec& matches,
+        matchinfovec& infos) const {
+    match_event_particles(recojets, genjets, nullptr, matches, &infos);
+}
+
+void matching::TrackMatcher::matchEventParticles(
+        const std::vector<simon::jet>& recojets,
+        const GenIndex& genindex,
+        eventmatchvec& matches) const {
+    check_index(genindex);
+    match_event_particles(recojets, genindex.get_jets(), &genindex,
+                          matches, nullptr);
+}
+
+void matching::TrackMatcher::matchEventParticles(
+        const std::vector<simon::jet>& recojets,
+        const GenIndex& genindex,
+        eventmatchvec& matches,
+        matchinfovec& infos) const {
+    check_index(genindex);
+    match_event_particles(recojets, genindex.get_jets(), &genindex,
+                          matches, &infos);
+}
+
+void matching::TrackMatcher::match_event_particles(
+        const std::vector<simon::jet>& recojets,
+        const std::vector<simon::jet>& genjets,
+        const GenIndex* genindex,
+        eventmatchvec& matches,
+        matchinfovec* infos) const {
+    MATCHING_TRACE_SCOPE("matchEventParticles");
+
+    matches.clear();
+    if(infos){
+        infos->clear();
+    }
+
+    std::vector<simon::particle> recoparts;
+    std::vector<size_t> reco_jetidxs, reco_partidxs;
+    flatten_particles(recojets, particle_params, 
+                      recoparts, reco_jetidxs, reco_partidxs);
+
+    //the gen side comes either from the GenIndex or is flattened here
+    std::vector<simon::particle> genparts;
+    std::vector<size_t> gen_jetidxs, gen_partidxs;
+    CandidateGraph graph;
+    if(genindex){
+        graph.build(recoparts, *genindex,
+                    particle_params, max_chisq);
+    } else {
+        flatten_particles(genjets, particle_params,
+                          genparts, gen_jetidxs, gen_partidxs);
+        graph.build(recoparts, genparts,
+                    particle_params, max_chisq,
+                    CandidateGraph::GRID);
+    }
+
+    matchvec flatmatches;
+    assign_greedy(graph, flatmatches, infos);
+
+    //project back onto the jet constituents
+    matches.reserve(flatmatches.size());
+    for(const auto& match : flatmatches){
+        if(genindex){
+            matches.emplace_back(
+                    reco_jetidxs[match.iReco], reco_partidxs[match.iReco],
+                    genindex->jet_of(match.iGen), 
+                    genindex->constituent_of(match.iGen));
+        } else {
+            matches.emplace_back(
+                    reco_jetidxs[match.iReco], reco_partidxs[match.iReco],
+                    gen_jetidxs[match.iGen], gen_partidxs[match.iGen]);
+        }
+    }
+}
+
+void matching::TrackMatcher::buildCandidateGraph(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const CandidateGraph::Strategy strategy,
+        CandidateGraph& graph) const {
+
+    unsigned nthreads = 1;
+    const size_t npairs = recojet.particles.size() * genjet.particles.size();
+    if(parallel_threshold > 0 && npairs >= parallel_threshold){
+        nthreads = parallel_nthreads;
+        if(nthreads == 0){
+            nthreads = std::thread::hardware_concurrency();
+        }
+    }
+
+    graph.build(recojet.particles, genjet.particles,
+                particle_params, max_chisq,
+                strategy, nthreads,
+                max_candidates_per_gen,
+                max_pair_evaluations,
+                recojet.pt, genjet.pt);
+}
+
+void matching::TrackMatcher::matchParticleToys(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const std::vector<simon::jet>& replicas,
+        std::vector<matchvec>& matches) const {
+    match_particle_toys(recojet, genjet, replicas, matches, nullptr);
+}
+
+void matching::TrackMatcher::matchParticleToys(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const std::vector<simon::jet>& replicas,
+        std::vector<matchvec>& matches,
+        std::vector<matchinfovec>& infos) const {
+    match_particle_toys(recojet, genjet, replicas, matches, &infos);
+}
+
+void matching::TrackMatcher::match_particle_toys(
+        const simon::jet& recojet,
+        const simon::jet& genjet,
+        const std::vector<simon::jet>& replicas,
+        std::vector<matchvec>& matches,
+        std::vector<matchinfovec>* infos) const {
+
+    ToyCandidateSet toyset;
+    toyset.build(recojet.particles, genjet.particles,
+                 particle_params, max_chisq,
+                 toy_envelope, genjet.pt);
+
+    matches.resize(replicas.size());
+    if(infos){
+        infos->resize(replicas.size());
+    }
+    for(size_t iToy=0; iToy<replicas.size(); ++iToy){
+        toyset.match(replicas[iToy].particles, replicas[iToy].pt,
+                     matches[iToy],
+                     infos ? &(*infos)[iToy] : nullptr);
+    }
+}
+
+void matching::TrackMatcher::makeToyReplicas(
+        const simon::jet& recojet,
+        const size_t nToys,
+        const unsigned long long seed,
+        std::vector<simon::jet>& replicas) const {
+
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> gaus(0, 1);
+
+    replicas.assign(nToys, recojet);
+    for(auto& replica : replicas){
+        for(auto& part : replica.particles){
+            const auto* theparms = particle_params.get_params(part);
+            if(!theparms) continue;
+
+            const double ptres = theparms->chi_sq_fn.pt_resolution(
+                    part.pt, part.eta, part.phi, part.charge);
+            const double angres = theparms->chi_sq_fn.ang_resolution(
+                    part.pt, part.eta, part.phi, part.charge);
+
+            if(ptres > 0 && part.pt > 0){
+                double pt;
+                do {
+                    pt = part.pt + ptres * gaus(rng);
+                } while(!(pt > 0));
+                part.pt = pt;
+            }
+            part.eta += angres * gaus(rng);
+            part.phi += angres * gaus(rng);
+        }
+    }
+}
+
+void matching::TrackMatcher::check_not_recording() const {
+    if(recorder){
+        throw std::runtime_error("TrackMatcher configuration cannot be changed while recording");
+    }
+}
+
+void matching::TrackMatcher::setToyEnvelope(const double envelope){
+    check_not_recording();
+    if(!(envelope >= 1)){
+        throw std::invalid_argument("Toy dR envelope must be >= 1");
+    }
+    toy_envelope = envelope;
+}
+
+void matching::TrackMatcher::setParallelism(
+        const size_t threshold,
+        const unsigned nthreads){
+    check_not_recording();
+    parallel_threshold = threshold;
+    parallel_nthreads = nthreads;
+}
+
+void matching::TrackMatcher::setCandidateLimits(
+        const size_t max_candidates_per_gen,
+        const size_t max_pair_evaluations){
+    check_not_recording();
+    this->max_candidates_per_gen = max_candidates_per_gen;
+    this->max_pair_evaluations = max_pair_evaluations;
+}
+
+void matching::TrackMatcher::setAcceptance(
+        const PerFlavorMatchParams::Flavor flavor,
+        const Acceptance& acceptance){
+    check_not_recording();
+    particle_params.set_acceptance(flavor, acceptance);
+}
+
+void matching::TrackMatcher::setAutoStrategy(const bool automatic){
+    check_not_recording();
+    auto_strategy = automatic;
+}
+
+void matching::TrackMatcher::setCostModel(const MatchCostModel& model){
+    check_not_recording();
+    cost_model = model;
+}
+
+/*
+ * Synthetic jet for the cost model calibration: 
+ * n particles of mixed flavors spread uniformly over 
+ * [-spread, spread] in eta and phi, and a slightly smeared 
+ * reco copy, so that most of them find a match
+ */
+static void make_calibration_jet(
+        const size_t n,
+        const double spread,
+        std::mt19937& rng,
+        std::vector<simon::particle>& recoparts,
+        std::vector<simon::particle>& genparts){
+    static const int pdgids[] = {211, -211, 22, 130, 11, 13};
+    static const int charges[] = {1, -1, 0, 0, -1, -1};
+
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::normal_distribution<double> gauss(0, 1);
+
+    genparts.resize(n);
+    recoparts.resize(n);
+    for(size_t i=0; i<n; ++i){
+        auto& gen = genparts[i];
+        gen.pt = 1 + 30*std::abs(uniform(rng));
+        gen.eta = spread*uniform(rng);
+        gen.phi = spread*uniform(rng);
+        gen.pdgid = pdgids[i%6];
+        gen.charge = charges[i%6];
+
+        auto& reco = recoparts[i];
+        reco = gen;
+        reco.pt *= 1 + 0.01*gauss(rng);
+        reco.eta += 0.002*gauss(rng);
+        reco.phi += 0.002*gauss(rng);
+    }
+}
+
+//fastest of a few batches of at least 2ms
+template <typename F>
+static double time_per_call_ns(F&& f){
+    using clock = std::chrono::steady_clock;
+
+    double best = INF;
+    for(int batch=0; batch<5; ++batch){
+        size_t ncalls = 0;
+        const auto start = clock::now();
+        do {
+            f();
+            ++ncalls;
+        } while(clock::now() - start < std::chrono::milliseconds(2));
+        const std::chrono::duration<double, std::nano> elapsed = clock::now() - start;
+        best = std::min(best, elapsed.count()/ncalls);
+    }
+    return best;
+}
+
+matching::MatchCostModel matching::TrackMatcher::calibrateCostModel() const {
+    MATCHING_TRACE_SCOPE("calibrateCostModel");
+
+    static constexpr size_t NDENSE = 384;
+    static constexpr size_t NWIDE = 1024;
+
+    std::mt19937 rng(12345);
+    std::vector<simon::particle> recoparts, genparts;
+    matchvec matches;
+    MatchCostModel model;
+
+    unsigned nthreads = parallel_nthreads;
+    if(nthreads == 0){
+        nthreads = std::thread::hardware_concurrency();
+    }
+
+    auto time_graph = [&](const CandidateGraph::Strategy strategy,
+                          const unsigned graph_nthreads,
+                          size_t& npairs){
+        CandidateGraph graph;
+        double ns = time_per_call_ns([&](){
+            graph.build(recoparts, genparts,
+                        particle_params, max_chisq,
+                        strategy, graph_nthreads);
+            assign_greedy(graph, matches);
+        });
+        npairs = graph.get_truncation().nPairsEvaluated;
+        return ns;
+    };
+
+    //dense jet: every pair is evaluated by all the brute force paths
+    make_calibration_jet(NDENSE, 0.4, rng, recoparts, genparts);
+    const double densepairs = static_cast<double>(NDENSE)*NDENSE;
+    size_t npairs;
+
+    model.pair_ns = time_per_call_ns([&](){
+        matches.clear();
+        match_one_to_one(recoparts, genparts,
+                         0, 0, nullptr, nullptr,
+                         particle_params, max_chisq,
+                         0, 1, 0, 0, nullptr,
+                         matches, nullptr, nullptr);
+    }) / densepairs;
+
+    const double bruteforce_ns = time_graph(CandidateGraph::BRUTEFORCE, 1, npairs);
+    model.graph_pair_ns = bruteforce_ns / densepairs;
+
+    if(nthreads > 1){
+        const double parallel_ns = time_graph(CandidateGraph::BRUTEFORCE, nthreads, npairs);
+        model.thread_ns = std::max(0.0, 
+                (parallel_ns - bruteforce_ns/nthreads)/nthreads);
+    }
+
+    //wide sparse event: the grid overhead per particle
+    make_calibration_jet(NWIDE, M_PI, rng, recoparts, genparts);
+    const double grid_ns = time_graph(CandidateGraph::GRID, 1, npairs);
+    model.grid_particle_ns = std::max(0.0,
+            (grid_ns - model.graph_pair_ns*npairs)/(2*NWIDE));
+
+    return model;
+}
+
+void matching::TrackMatcher::setRecorder(EventDumpWriter* recorder){
+    if(recorder && recorder->get_config() != getConfig()){
+        throw std::invalid_argument("EventDumpWriter was created with a different matcher configuration");
+    }
+    this->recorder = recorder;
+}
+
+static const char* const FLAVOR_NAMES[matching::PerFlavorMatchParams::NFLAVORS] = {
+    "ELE", "MU", "HADCH", "PHO", "HAD0"
+};
+
+std::string matching::TrackMatcher::getConfig() const {
+    std::string result;
+    char line[256];
+    auto add_double = [&](const std::string& name, const double value){
+        snprintf(line, sizeof(line), " %.17g\n", value);
+        result += name + line;
+    };
+    auto add_string = [&](const std::string& name, const std::string& value){
+        result += name + " " + value + "\n";
+    };
+
+    add_double("jet_dR_threshold", jet_dR_threshold);
+    add_double("max_chisq", max_chisq);
+    add_double("parallel_threshold", parallel_threshold);
+    add_double("parallel_nthreads", parallel_nthreads);
+    add_double("max_candidates_per_gen", max_candidates_per_gen);
+    add_double("max_pair_evaluations", max_pair_evaluations);
+    add_double("auto_strategy", auto_strategy);
+    add_double("cost_model.pair_ns", cost_model.pair_ns);
+    add_double("cost_model.graph_pair_ns", cost_model.graph_pair_ns);
+    add_double("cost_model.grid_particle_ns", cost_model.grid_particle_ns);
+    add_double("cost_model.thread_ns", cost_model.thread_ns);
+    add_double("toy_dR_envelope", toy_envelope);
+
+    for(unsigned flavor=0; flavor<PerFlavorMatchParams::NFLAVORS; ++flavor){
+        const auto F = static_cast<PerFlavorMatchParams::Flavor>(flavor);
+        const std::string prefix = std::string(FLAVOR_NAMES[flavor]) + ".";
+        const auto& cfg = particle_params.get_config(F);
+        add_string(prefix + "dr_mode", cfg.dr_mode);
+        add_double(prefix + "dr_param1", cfg.dr_param1);
+        add_double(prefix + "dr_param2", cfg.dr_param2);
+        add_double(prefix + "dr_param3", cfg.dr_param3);
+        add_string(prefix + "ptres_mode", cfg.ptres_mode);
+        add_double(prefix + "ptres_param1", cfg.ptres_param1);
+        add_double(prefix + "ptres_param2", cfg.ptres_param2);
+        add_string(prefix + "angres_mode", cfg.angres_mode);
+        add_double(prefix + "angres_param1", cfg.angres_param1);
+        add_double(prefix + "angres_param2", cfg.angres_param2);
+        add_double(prefix + "opp_charge_penalty", cfg.opp_charge_penalty);
+        add_double(prefix + "no_charge_penalty", cfg.no_charge_penalty);
+        add_string(prefix + "charge_filter_mode", cfg.charge_filter_mode);
+        add_string(prefix + "flavor_filter_mode", cfg.flavor_filter_mode);
+
+        const auto& acc = particle_params.get_acceptance(F);
+        add_double(prefix + "min_pt", acc.min_pt);
+        add_double(prefix + "max_pt", acc.max_pt);
+        add_double(prefix + "max_abseta", acc.max_abseta);
+        add_double(prefix + "min_ptfrac", acc.min_ptfrac);
+    }
+    return result;
+}
+
+matching::TrackMatcher matching::TrackMatcher::fromConfig(const std::string& config){
+    std::map<std::string, std::string> values;
+    size_t start = 0;
+    while(start < config.size()){
+        size_t end = config.find('\n', start);
+        if(end == std::string::npos){
+            end = config.size();
+        }
+        const std::string line = config.substr(start, end-start);
+        start = end+1;
+        if(line.empty()) continue;
+
+        const size_t space = line.find(' ');
+        if(space == std::string::npos){
+            throw std::invalid_argument("Invalid matcher configuration line: " + line);
+        }
+        values[line.substr(0, space)] = line.substr(space+1);
+    }
+
+    //every parameter must be used exactly once
+    auto take = [&](const std::string& name){
+        auto it = values.find(name);
+        if(it == values.end()){
+            throw std::invalid_argument("Missing matcher configuration parameter " + name);
+        }
+        std::string value = it->second;
+        values.erase(it);
+        return value;
+    };
+    auto take_double = [&](const std::string& name){
+        const std::string value = take(name);
+        char* end;
+        const double result = std::strtod(value.c_str(), &end);
+        if(value.empty() || *end != '\0'){
+            throw std::invalid_argument("Invalid value of matcher configuration parameter " + name);
+        }
+        return result;
+    };
+
+    const double jet_dR_threshold = take_double("jet_dR_threshold");
+    const double max_chisq = take_double("max_chisq");
+
+    std::array<MatchParamsRegistry::config, PerFlavorMatchParams::NFLAVORS> cfgs;
+    std::array<Acceptance, PerFlavorMatchParams::NFLAVORS> accs;
+    for(unsigned flavor=0; flavor<PerFlavorMatchParams::NFLAVORS; ++flavor){
+        const std::string prefix = std::string(FLAVOR_NAMES[flavor]) + ".";
+        auto& cfg = cfgs[flavor];
+        cfg.dr_mode = take(prefix + "dr_mode");
+        cfg.dr_param1 = take_double(prefix + "dr_param1");
+        cfg.dr_param2 = take_double(prefix + "dr_param2");
+        cfg.dr_param3 = take_double(prefix + "dr_param3");
+        cfg.ptres_mode = take(prefix + "ptres_mode");
+        cfg.ptres_param1 = take_double(prefix + "ptres_param1");
+        cfg.ptres_param2 = take_double(prefix + "ptres_param2");
+        cfg.angres_mode = take(prefix + "angres_mode");
+        cfg.angres_param1 = take_double(prefix + "angres_param1");
+        cfg.angres_param2 = take_double(prefix + "angres_param2");
+        cfg.opp_charge_penalty = take_double(prefix + "opp_charge_penalty");
+        cfg.no_charge_penalty = take_double(prefix + "no_charge_penalty");
+        cfg.charge_filter_mode = take(prefix + "charge_filter_mode");
+        cfg.flavor_filter_mode = take(prefix + "flavor_filter_mode");
+
+        auto& acc = accs[flavor];
+        acc.min_pt = take_double(prefix + "min_pt");
+        acc.max_pt = take_double(prefix + "max_pt");
+        acc.max_abseta = take_double(prefix + "max_abseta");
+        acc.min_ptfrac = take_double(prefix + "min_ptfrac");
+    }
+
+    const auto& ele = cfgs[PerFlavorMatchParams::ELE];
+    const auto& mu = cfgs[PerFlavorMatchParams::MU];
+    const auto& hadch = cfgs[PerFlavorMatchParams::HADCH];
+    const auto& pho = cfgs[PerFlavorMatchParams::PHO];
+    const auto& had0 = cfgs[PerFlavorMatchParams::HAD0];
+
+    TrackMatcher result(
+        jet_dR_threshold, max_chisq,
+        ele.dr_mode, ele.dr_param1, ele.dr_param2, ele.dr_param3,
+        ele.ptres_mode, ele.ptres_param1, ele.ptres_param2,
+        ele.angres_mode, ele.angres_param1, ele.angres_param2,
+        ele.opp_charge_penalty, ele.no_charge_penalty,
+        ele.charge_filter_mode, ele.flavor_filter_mode,
+        mu.dr_mode, mu.dr_param1, mu.dr_param2, mu.dr_param3,
+        mu.ptres_mode, mu.ptres_param1, mu.ptres_param2,
+        mu.angres_mode, mu.angres_param1, mu.angres_param2,
+        mu.opp_charge_penalty, mu.no_charge_penalty,
+        mu.charge_filter_mode, mu.flavor_filter_mode,
+        hadch.dr_mode, hadch.dr_param1, hadch.dr_param2, hadch.dr_param3,
+        hadch.ptres_mode, hadch.ptres_param1, hadch.ptres_param2,
+        hadch.angres_mode, hadch.angres_param1, hadch.angres_param2,
+        hadch.opp_charge_penalty, hadch.no_charge_penalty,
+        hadch.charge_filter_mode, hadch.flavor_filter_mode,
+        pho.dr_mode, pho.dr_param1, pho.dr_param2, pho.dr_param3,
+        pho.ptres_mode, pho.ptres_param1, pho.ptres_param2,
+        pho.angres_mode, pho.angres_param1, pho.angres_param2,
+        pho.opp_charge_penalty, pho.no_charge_penalty,
+        pho.charge_filter_mode, pho.flavor_filter_mode,
+        had0.dr_mode, had0.dr_param1, had0.dr_param2, had0.dr_param3,
+        had0.ptres_mode, had0.ptres_param1, had0.ptres_param2,
+        had0.angres_mode, had0.angres_param1, had0.angres_param2,
+        had0.opp_charge_penalty, had0.no_charge_penalty,
+        had0.charge_filter_mode, had0.flavor_filter_mode);
+
+    for(unsigned flavor=0; flavor<PerFlavorMatchParams::NFLAVORS; ++flavor){
+        result.setAcceptance(static_cast<PerFlavorMatchParams::Flavor>(flavor), 
+                             accs[flavor]);
+    }
+
+    const double parallel_threshold = take_double("parallel_threshold");
+    const double parallel_nthreads = take_double("parallel_nthreads");
+    result.setParallelism(parallel_threshold, parallel_nthreads);
+
+    const double max_candidates = take_double("max_candidates_per_gen");
+    const double max_pairs = take_double("max_pair_evaluations");
+    result.setCandidateLimits(max_candidates, max_pairs);
+
+    MatchCostModel model;
+    model.pair_ns = take_double("cost_model.pair_ns");
+    model.graph_pair_ns = take_double("cost_model.graph_pair_ns");
+    model.grid_particle_ns = take_double("cost_model.grid_particle_ns");
+    model.thread_ns = take_double("cost_model.thread_ns");
+    result.setCostModel(model);
+    result.setAutoStrategy(take_double("auto_strategy") != 0);
+
+    result.setToyEnvelope(take_double("toy_dR_envelope"));
+
+    if(!values.empty()){
+        throw std::invalid_argument("Unknown matcher configuration parameter " 
+                                    + values.begin()->first);
+    }
+    return result;
+}
+
 #ifdef CMSSW_GIT_HASH
 matching::TrackMatcher::TrackMatcher(const edm::ParameterSet& iConfig) :
     jet_dR_threshold(iConfig.getParameter<double>("jet_dR_threshold")),
     max_chisq(iConfig.getParameter<double>("max_chisq")),
+    parallel_threshold(iConfig.getParameter<unsigned long long>("parallel_threshold")),
+    parallel_nthreads(iConfig.getParameter<unsigned>("parallel_nthreads")),
+    max_candidates_per_gen(iConfig.getParameter<unsigned long long>("max_candidates_per_gen")),
+    max_pair_evaluations(iConfig.getParameter<unsigned long long>("max_pair_evaluations")),
+    auto_strategy(false),
+    cost_model(),
+    toy_envelope(iConfig.getParameter<double>("toy_dR_envelope")),
+    recorder(nullptr),
     particle_params() {
 
+    if(!(toy_envelope >= 1)){
+        throw std::invalid_argument("Toy dR envelope must be >= 1");
+    }
+
     particle_params.setup_params(
         PerFlavorMatchParams::ELE,
         iConfig.getParameter<edm::ParameterSet>("Electrons")
@@ -272,11 +1449,42 @@ matching::TrackMatcher::TrackMatcher(const edm::ParameterSet& iConfig) :
         PerFlavorMatchParams::HADCH,
         iConfig.getParameter<edm::ParameterSet>("ChargedHadrons")
     );
+    particle_params.setup_params(
+        PerFlavorMatchParams::PHO,
+        iConfig.getParameter<edm::ParameterSet>("Photons")
+    );
+    particle_params.setup_params(
+        PerFlavorMatchParams::HAD0,
+        iConfig.getParameter<edm::ParameterSet>("NeutralHadrons")
+    );
+
+    particle_params.validate();
+
+    const auto& selection = iConfig.getParameter<std::string>("strategy_selection");
+    if(selection == "auto"){
+        const auto& path = iConfig.getParameter<std::string>("cost_model_file");
+        if(path.empty()){
+            cost_model = calibrateCostModel();
+        } else {
+            cost_model = MatchCostModel::load(path);
+        }
+        auto_strategy = true;
+    } else if(selection != "threshold"){
+        throw std::invalid_argument("Invalid strategy selection mode");
+    }
 }
 
 void matching::TrackMatcher::fillPSetDescription(edm::ParameterSetDescription& desc){
     desc.add<double>("jet_dR_threshold");
     desc.add<double>("max_chisq");
+    //parallel matching is opt-in
+    desc.add<unsigned long long>("parallel_threshold", 0);
+    desc.add<unsigned>("parallel_nthreads", 1);
+    desc.add<unsigned long long>("max_candidates_per_gen", 0);
+    desc.add<unsigned long long>("max_pair_evaluations", 0);
+    desc.add<std::string>("strategy_selection", "threshold");
+    desc.add<std::string>("cost_model_file", "");
+    desc.add<double>("toy_dR_envelope", DEFAULT_TOY_ENVELOPE);
 
     edm::ParameterSetDescription ele_desc;
     MatchParams::fillPSetDescription(ele_desc);
@@ -289,5 +1497,13 @@ void matching::TrackMatcher::fillPSetDescription(edm::ParameterSetDescription& d
     edm::ParameterSetDescription hadch_desc;
     MatchParams::fillPSetDescription(hadch_desc);
     desc.add<edm::ParameterSetDescription>("ChargedHadrons", hadch_desc);
+
+    edm::ParameterSetDescription pho_desc;
+    MatchParams::fillPSetDescription(pho_desc);
+    desc.add<edm::ParameterSetDescription>("Photons", pho_desc);
+
+    edm::ParameterSetDescription had0_desc;
+    MatchParams::fillPSetDescription(had0_desc);
+    desc.add<edm::ParameterSetDescription>("NeutralHadrons", had0_desc);
 }
 #endif
@@ -3,6 +3,13 @@
 
 #include "SRothman/SimonTools/src/jet.h"
 #include "PerFlavorMatchParams.h"
+#include "EventDump.h"
+#include "MatchTypes.h"
+#include "CandidateGraph.h"
+#include "MatchAccumulator.h"
+#include "GenIndex.h"
+#include "MatchCostModel.h"
+#include "ToyCandidateSet.h"
 
 #include <string>
 #include <vector>
@@ -13,12 +20,6 @@
 #endif
 
 namespace matching {
-    struct matchidxs {
-        size_t iReco, iGen;
-        matchidxs(size_t iReco, size_t iGen) : iReco(iReco), iGen(iGen) {}
-    };
-    using matchvec = std::vector<matchidxs>;
-
     class TrackMatcher {
     public:
         TrackMatcher(
@@ -74,17 +75,356 @@ namespace matching {
                 const double hadch_opp_charge_penalty,
                 const double hadch_no_charge_penalty,
                 const std::string& hadch_charge_filter_mode,
-                const std::string& hadch_flavor_filter_mode);
+                const std::string& hadch_flavor_filter_mode,
+
+                //photon params
+                const std::string& pho_dr_mode,
+                const double pho_dr_param1,
+                const double pho_dr_param2,
+                const double pho_dr_param3,
+                const std::string& pho_ptres_mode,
+                const double pho_ptres_param1,
+                const double pho_ptres_param2,
+                const std::string& pho_angres_mode,
+                const double pho_angres_param1,
+                const double pho_angres_param2,
+                const double pho_opp_charge_penalty,
+                const double pho_no_charge_penalty,
+                const std::string& pho_charge_filter_mode,
+                const std::string& pho_flavor_filter_mode,
+
+                //neutral hadron params
+                const std::string& had0_dr_mode,
+                const double had0_dr_param1,
+                const double had0_dr_param2,
+                const double had0_dr_param3,
+                const std::string& had0_ptres_mode,
+                const double had0_ptres_param1,
+                const double had0_ptres_param2,
+                const std::string& had0_angres_mode,
+                const double had0_angres_param1,
+                const double had0_angres_param2,
+                const double had0_opp_charge_penalty,
+                const double had0_no_charge_penalty,
+                const std::string& had0_charge_filter_mode,
+                const std::string& had0_flavor_filter_mode);
+
+        void matchJets(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            matchvec& matches) const;
 
         void matchJets(
             const std::vector<simon::jet>& recojets,
             const std::vector<simon::jet>& genjets,
-            matchvec& matches);
+            matchvec& matches,
+            matchinfovec& infos) const;
+
+        /*
+         * Builds the gen-side index of an event, so that several 
+         * reco collections can be matched against the same gen jets
+         * without re-sorting and re-scanning them every time.
+         * The overloads taking a GenIndex give identical results
+         * to the ones taking the gen jets directly.
+         * The index must not outlive genjets or this TrackMatcher
+         */
+        void buildGenIndex(
+            const std::vector<simon::jet>& genjets,
+            GenIndex& genindex) const;
+
+        void matchJets(
+            const std::vector<simon::jet>& recojets,
+            const GenIndex& genindex,
+            matchvec& matches) const;
+
+        void matchJets(
+            const std::vector<simon::jet>& recojets,
+            const GenIndex& genindex,
+            matchvec& matches,
+            matchinfovec& infos) const;
+
+        void matchParticles(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            Eigen::MatrixXd& tmat) const;
+
+        //iGenJet is the index of the gen jet in the indexed event
+        void matchParticles(
+            const simon::jet& recojet,
+            const GenIndex& genindex,
+            const size_t iGenJet,
+            Eigen::MatrixXd& tmat) const;
 
         void matchParticles(
+            const simon::jet& recojet,
+            const GenIndex& genindex,
+            const size_t iGenJet,
+            Eigen::MatrixXd& tmat,
+            matchvec& matches,
+            matchinfovec& infos) const;
+
+        //also returns the matched index pairs 
+        //and the matchinfo for each of them
+        void matchParticles(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            Eigen::MatrixXd& tmat,
+            matchvec& matches,
+            matchinfovec& infos) const;
+
+        //also reports whether the candidate limits 
+        //(setCandidateLimits()) truncated the search
+        void matchParticles(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            Eigen::MatrixXd& tmat,
+            matchvec& matches,
+            matchinfovec& infos,
+            truncationinfo& truncation) const;
+
+        /*
+         * Matches the particles and passes the result straight 
+         * to an accumulator, without building a transfer matrix
+         * For multi-threaded jobs use one accumulator per thread
+         * and merge them at the end
+         */
+        void matchParticles(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            MatchAccumulator& accumulator) const;
+
+        /*
+         * Matches the jets, and then the particles of every matched 
+         * jet pair, in one call, with all the results in one 
+         * contiguous eventresult (see MatchTypes.h)
+         * The result is the same as matchJets() followed by 
+         * matchParticles() on each matched pair, without building
+         * the transfer matrices
+         * Reusing the eventresult avoids reallocating the outputs; 
+         * only jet pairs within SMALL_JET_CAPACITY are matched 
+         * without any scratch allocation
+         */
+        void matchEvent(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            eventresult& result) const;
+
+        void matchEvent(
+            const std::vector<simon::jet>& recojets,
+            const GenIndex& genindex,
+            eventresult& result) const;
+
+        /*
+         * Event-level particle matching
+         *
+         * All the particles in recojets are matched against all the 
+         * particles in genjets in a single one-to-one matching, 
+         * regardless of which jets they belong to or whether the jets
+         * themselves are matched. Candidates are found with one spatial
+         * index over all gen particles in the event, so the cost scales 
+         * with the local particle density rather than nReco * nGen.
+         * The result is identical to matching the concatenated 
+         * particle collections with matchParticles().
+         *
+         * Each particle is assumed to belong to only one jet.
+         */
+        void matchEventParticles(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            eventmatchvec& matches) const;
+
+        void matchEventParticles(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            eventmatchvec& matches,
+            matchinfovec& infos) const;
+
+        //reuses the grid and pT order of the GenIndex
+        void matchEventParticles(
+            const std::vector<simon::jet>& recojets,
+            const GenIndex& genindex,
+            eventmatchvec& matches) const;
+
+        void matchEventParticles(
+            const std::vector<simon::jet>& recojets,
+            const GenIndex& genindex,
+            eventmatchvec& matches,
+            matchinfovec& infos) const;
+
+        /*
+         * Builds the graph of admissible particle pairs for a jet,
+         * using this matcher's configuration. 
+         * Pass it to assign_greedy() to get the same result as
+         * matchParticles(), or to any other assignment routine
+         * The pair evaluation is split across threads according to
+         * setParallelism() when the strategy is BRUTEFORCE, 
+         * and the limits of setCandidateLimits() are applied
+         */
+        void buildCandidateGraph(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            const CandidateGraph::Strategy strategy,
+            CandidateGraph& graph) const;
+
+        /*
+         * Toy (bootstrap) re-matching for uncertainty estimates
+         *
+         * Matches every replica of the reco jet against the gen jet,
+         * with the same result as calling matchParticles() on each 
+         * replica, but with the candidate search done only once 
+         * (see ToyCandidateSet and setToyEnvelope()). 
+         * The replicas must differ from recojet only in the pT, eta 
+         * and phi of the particles (and the jet pT).
+         * matches[i] (and infos[i]) are the result of replica i
+         * The candidate limits do not apply
+         */
+        void matchParticleToys(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            const std::vector<simon::jet>& replicas,
+            std::vector<matchvec>& matches) const;
+
+        void matchParticleToys(
             const simon::jet& recojet,
             const simon::jet& genjet,
-            Eigen::MatrixXd& tmat);
+            const std::vector<simon::jet>& replicas,
+            std::vector<matchvec>& matches,
+            std::vector<matchinfovec>& infos) const;
+
+        /*
+         * Seeded smearing model for the toys: each replica smears the 
+         * pT of every matchable reco particle by a Gaussian of width
+         * its pT resolution, and eta and phi each by a Gaussian of 
+         * width its angular resolution, both from the chisq ResFuncs
+         * of the particle's flavor. The pT is redrawn until positive.
+         * The jet itself is not changed.
+         * The same seed always gives the same replicas
+         */
+        void makeToyReplicas(
+            const simon::jet& recojet,
+            const size_t nToys,
+            const unsigned long long seed,
+            std::vector<simon::jet>& replicas) const;
+
+        /*
+         * Widening factor (>= 1) of the reco dR limits for the toy 
+         * candidate search. It only affects the speed of the toys:
+         * replica particles that moved out of the envelope fall back 
+         * to a full search
+         */
+        void setToyEnvelope(const double envelope);
+
+        static constexpr double DEFAULT_TOY_ENVELOPE = 2.0;
+
+        /*
+         * Large jets are matched with the candidate evaluation 
+         * split across threads. This kicks in when 
+         * nReco * nGen >= threshold. The result is identical 
+         * to the sequential matching.
+         *
+         * threshold = 0 disables the parallel path
+         * nthreads = 0 uses std::thread::hardware_concurrency()
+         *
+         * Off by default (threshold 0, nthreads 1): each parallel call 
+         * starts nthreads-1 new threads, which oversubscribes the CPU
+         * when the framework already runs one matcher per stream.
+         * Set both explicitly to opt in; a threshold of 
+         * SUGGESTED_PARALLEL_THRESHOLD is a reasonable starting point
+         */
+        void setParallelism(const size_t threshold,
+                            const unsigned nthreads);
+
+        static constexpr size_t SUGGESTED_PARALLEL_THRESHOLD = 250000;
+
+        /*
+         * Jets with at most this many reco and gen particles
+         * (and no candidate limits) are matched with an allocation-free
+         * path: stack arrays, a sorting network for the pT ordering 
+         * and a bitmask of the used reco particles. 
+         * The result is identical to the general path.
+         * At most 64, the width of the bitmask
+         */
+        static constexpr size_t SMALL_JET_CAPACITY = 64;
+
+        /*
+         * Bounded-latency mode for the particle matching of each jet
+         *
+         * max_candidates_per_gen: each gen particle keeps only its 
+         *     best max_candidates_per_gen reco candidates. If they are all
+         *     taken by higher-pT gen particles it is left unmatched
+         * max_pair_evaluations: at most this many (reco, gen) pairs
+         *     are evaluated per jet. Gen particles are evaluated in 
+         *     decreasing pT order, and the ones beyond the cap 
+         *     are left unmatched
+         *
+         * 0 = unlimited (the default), which gives the exact matching.
+         * With limits the result is an approximation; the matchParticles()
+         * overload taking a truncationinfo reports when a limit kicked in.
+         * Limited jets always use the brute force CandidateGraph, also 
+         * with setAutoStrategy(true), so the matches never depend on 
+         * the cost model
+         * Does not apply to matchEventParticles()
+         */
+        void setCandidateLimits(const size_t max_candidates_per_gen,
+                                const size_t max_pair_evaluations);
+
+        /*
+         * Per-flavor kinematic acceptance (see Acceptance)
+         * Reco and gen particles outside the acceptance of their flavor
+         * are dropped before any pair is formed, and are reported as 
+         * unmatched. The pT fraction cut is relative to the pT of the
+         * particle's own jet. By default there are no cuts
+         * The same can be configured with the min_pt, max_pt, max_abseta
+         * and min_ptfrac parameters of each flavor PSet
+         */
+        void setAcceptance(const PerFlavorMatchParams::Flavor flavor,
+                           const Acceptance& acceptance);
+
+        /*
+         * Automatic strategy selection
+         *
+         * With automatic = true, each particle matching call picks 
+         * sequential brute force, the grid, or the parallel brute force
+         * from the cost model (see MatchCostModel), given the number of 
+         * particles, the largest dR limit of the reco particles and the
+         * area covered by the gen particles. The parallel_threshold 
+         * is then not used; parallel_nthreads still is.
+         * All strategies give identical results.
+         * Jets with candidate limits always use the brute force.
+         *
+         * calibrateCostModel() measures the coefficients of the model
+         * by matching synthetic jets with this configuration on the 
+         * running machine, which takes a fraction of a second
+         */
+        void setAutoStrategy(const bool automatic);
+        void setCostModel(const MatchCostModel& model);
+        MatchCostModel calibrateCostModel() const;
+
+        /*
+         * If set, every event passed to matchJets() or matchEvent() 
+         * is written to the recorder, together with the resulting
+         * matches, so that it can be replayed later and checked
+         * (see bin/replayMatching.cc)
+         * The recorder must have been created with this matcher's
+         * getConfig(), so the matcher must be fully configured 
+         * before recording starts; otherwise this throws
+         * While a recorder is attached the configuration is frozen:
+         * the other set*() methods throw
+         * nullptr disables recording
+         * The TrackMatcher does not take ownership
+         */
+        void setRecorder(EventDumpWriter* recorder);
+
+        /*
+         * Full matcher configuration as plain text, one "name value"
+         * pair per line: everything that affects the matches
+         * (constructor arguments, acceptance, candidate limits and 
+         * toy envelope) and the strategy settings 
+         * (parallelism, automatic strategy and cost model).
+         * fromConfig() builds an identical matcher from it
+         */
+        std::string getConfig() const;
+        static TrackMatcher fromConfig(const std::string& config);
 
 #ifdef CMSSW_GIT_HASH
         TrackMatcher(const edm::ParameterSet& iConfig);
@@ -96,6 +436,66 @@ namespace matching {
         const double jet_dR_threshold;
         const double max_chisq;
 
+        size_t parallel_threshold;
+        unsigned parallel_nthreads;
+
+        size_t max_candidates_per_gen;
+        size_t max_pair_evaluations;
+
+        bool auto_strategy;
+        MatchCostModel cost_model;
+
+        double toy_envelope;
+
+        EventDumpWriter* recorder;
+
+        //throws if a recorder is attached
+        void check_not_recording() const;
+
+        //infos, genindex and the gen-side pointers may be nullptr
+        //record = false leaves the recording to the caller
+        void match_jets(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            const std::vector<size_t>* gen_ptorder,
+            matchvec& matches,
+            matchinfovec* infos,
+            const bool record = true) const;
+
+        void match_particles(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            const std::vector<size_t>* gen_ptorder,
+            const uint8_t* gen_classes,
+            Eigen::MatrixXd& tmat,
+            matchvec& matches,
+            matchinfovec* infos,
+            truncationinfo* truncation) const;
+
+        //infos may be nullptr
+        void match_particle_toys(
+            const simon::jet& recojet,
+            const simon::jet& genjet,
+            const std::vector<simon::jet>& replicas,
+            std::vector<matchvec>& matches,
+            std::vector<matchinfovec>* infos) const;
+
+        void match_event(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            const GenIndex* genindex,
+            eventresult& result) const;
+
+        void match_event_particles(
+            const std::vector<simon::jet>& recojets,
+            const std::vector<simon::jet>& genjets,
+            const GenIndex* genindex,
+            eventmatchvec& matches,
+            matchinfovec* infos) const;
+
+        //throws if genindex was built by another TrackMatcher
+        void check_index(const GenIndex& genindex) const;
+
         PerFlavorMatchParams particle_params;
     };
 };
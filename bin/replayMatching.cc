@@ -0,0 +1,155 @@
+/*
+ * Standalone replay driver for event dumps written by
+ * TrackMatcher::setRecorder()
+ *
+ * usage: replayMatching <dump file> [nrepeat]
+ *
+ * Rebuilds the matcher from the configuration stored in the dump,
+ * runs matchJets() and matchParticles() over every event in the dump
+ * nrepeat times, and prints the total and per-event timing along
+ * with the slowest events, for benchmarking and regression timing.
+ *
+ * On the first pass (outside the timed section) the jet matches, and
+ * the particle matches if they were recorded, are compared with the 
+ * ones of the recording job; any difference is reported and makes 
+ * the exit code nonzero
+ */
+
+#include "../TrackMatcher.h"
+#include "../EventDump.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+struct eventtiming {
+    size_t iEvent;
+    size_t nPairs;
+    double seconds;
+};
+
+static bool same_matches(const matching::matchvec& m1,
+                         const matching::matchvec& m2,
+                         const size_t begin2,
+                         const size_t end2){
+    if(m1.size() != end2-begin2){
+        return false;
+    }
+    for(size_t i=0; i<m1.size(); ++i){
+        if(m1[i].iReco != m2[begin2+i].iReco || m1[i].iGen != m2[begin2+i].iGen){
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        printf("usage: %s <dump file> [nrepeat]\n", argv[0]);
+        return 1;
+    }
+    const size_t nrepeat = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+
+    try{
+        matching::EventDumpReader reader(argv[1]);
+        const matching::TrackMatcher matcher = 
+            matching::TrackMatcher::fromConfig(reader.get_config());
+
+        std::vector<simon::jet> recojets, genjets;
+        matching::matchvec jetmatches;
+        matching::eventresult recorded;
+        matching::matchvec particlematches;
+        matching::matchinfovec particleinfos;
+        Eigen::MatrixXd tmat;
+        std::vector<eventtiming> timings;
+        size_t nMismatched = 0;
+
+        for(size_t iRepeat=0; iRepeat<nrepeat; ++iRepeat){
+            reader.rewind();
+            size_t iEvent = 0;
+            while(reader.next(recojets, genjets, recorded)){
+                if(iRepeat == 0){
+                    matcher.matchJets(recojets, genjets, jetmatches);
+                    bool same = same_matches(jetmatches, recorded.jetmatches,
+                                             0, recorded.jetmatches.size());
+                    if(same && !recorded.offsets.empty()){
+                        for(size_t iJetMatch=0; iJetMatch<jetmatches.size(); ++iJetMatch){
+                            const auto& match = jetmatches[iJetMatch];
+                            matcher.matchParticles(recojets[match.iReco],
+                                                   genjets[match.iGen],
+                                                   tmat, particlematches,
+                                                   particleinfos);
+                            if(!same_matches(particlematches, 
+                                             recorded.particlematches,
+                                             recorded.offsets[iJetMatch],
+                                             recorded.offsets[iJetMatch+1])){
+                                same = false;
+                                break;
+                            }
+                        }
+                    }
+                    if(!same){
+                        printf("event %zu: matches differ from the recording\n", iEvent);
+                        ++nMismatched;
+                    }
+                }
+
+                size_t nPairs = 0;
+                auto start = std::chrono::steady_clock::now();
+
+                matcher.matchJets(recojets, genjets, jetmatches);
+                for(const auto& match : jetmatches){
+                    const auto& recojet = recojets[match.iReco];
+                    const auto& genjet = genjets[match.iGen];
+                    matcher.matchParticles(recojet, genjet, tmat);
+                    nPairs += recojet.particles.size() * genjet.particles.size();
+                }
+
+                auto end = std::chrono::steady_clock::now();
+                double seconds = std::chrono::duration<double>(end-start).count();
+
+                if(iRepeat == 0){
+                    timings.push_back({iEvent, nPairs, seconds});
+                } else {
+                    timings[iEvent].seconds = std::min(timings[iEvent].seconds, seconds);
+                }
+                ++iEvent;
+            }
+        }
+
+        double total = 0;
+        for(const auto& timing : timings){
+            total += timing.seconds;
+        }
+        printf("replayed %zu events x %zu repeats\n", timings.size(), nrepeat);
+        printf("total time (best of repeats): %.6f s\n", total);
+        if(!timings.empty()){
+            printf("mean time per event: %.3f us\n", 1e6*total/timings.size());
+        }
+
+        std::sort(timings.begin(), timings.end(),
+                [](const eventtiming& t1, const eventtiming& t2){
+                    return t1.seconds > t2.seconds;
+                });
+        printf("slowest events:\n");
+        for(size_t i=0; i<std::min<size_t>(10, timings.size()); ++i){
+            printf("\tevent %zu: %.3f us (%zu particle pairs)\n",
+                    timings[i].iEvent,
+                    1e6*timings[i].seconds,
+                    timings[i].nPairs);
+        }
+
+        if(nMismatched){
+            printf("%zu events do not reproduce the recorded matches\n", nMismatched);
+            return 1;
+        }
+        printf("all events reproduce the recorded matches\n");
+    } catch(const std::exception& e){
+        printf("ERROR: %s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}